@@ -0,0 +1,229 @@
+// Benchmarks the WASM engine entry points on real and synthetic Quirrel files.
+// Usage:
+//   node scripts/bench-wasm.mjs [options] [file or directory...]
+//     -n <runs>               Runs per file and entry point (default 10)
+//     --sizes <lines,...>     Synthetic file sizes (default 100,1000,10000,100000)
+//     --write-corpus <dir>    Also write the synthetic files there, e.g. for wasm/bench.cpp
+//     --json                  Print results as JSON instead of a table
+//
+// Reports latency percentiles and throughput per entry point and file,
+// and the peak WASM heap over the whole run.
+
+import { readdirSync, readFileSync, statSync, writeFileSync, mkdirSync, existsSync } from 'fs';
+import { join, resolve, relative } from 'path';
+import { pathToFileURL } from 'url';
+
+const ROOT = resolve(import.meta.dirname, '..');
+const WASM_JS = join(ROOT, 'out', 'quirrel-vscode.js');
+const DECLARATION_SAMPLES = 16;
+
+function parseArgs(argv) {
+  const options = { runs: 10, sizes: [100, 1000, 10000, 100000], writeCorpus: null, json: false, paths: [] };
+  for (let i = 0; i < argv.length; ++i) {
+    const arg = argv[i];
+    if (arg === '-n')
+      options.runs = Math.max(1, parseInt(argv[++i], 10) || 1);
+    else if (arg === '--sizes')
+      options.sizes = argv[++i].split(',').map(s => parseInt(s, 10)).filter(n => n > 0);
+    else if (arg === '--write-corpus')
+      options.writeCorpus = argv[++i];
+    else if (arg === '--json')
+      options.json = true;
+    else
+      options.paths.push(arg);
+  }
+  return options;
+}
+
+// Deterministic module of roughly `lines` lines, mixing the constructs
+// the engine spends time on: nested scopes, classes, tables, strings, comments
+function syntheticModule(lines) {
+  const out = ['// Synthetic benchmark module', 'let { max, min } = require("math")', ''];
+  let n = 0;
+  while (out.length < lines) {
+    const id = n++;
+    switch (id % 4) {
+      case 0:
+        out.push(
+          `/* Accumulates values with a limit of ${id} */`,
+          `function accumulate${id}(items, limit = ${id}) {`,
+          `  local total = 0`,
+          `  foreach (i, item in items) {`,
+          `    if (i > limit)`,
+          `      break`,
+          `    total += item.value * ${id % 7 + 1}`,
+          `  }`,
+          `  return max(total, limit)`,
+          `}`,
+          '');
+        break;
+      case 1:
+        out.push(
+          `class Widget${id} {`,
+          `  name = "widget ${id}"`,
+          `  size = ${id}`,
+          `  constructor(name, size) {`,
+          `    this.name = name`,
+          `    this.size = min(size, ${id * 3})`,
+          `  }`,
+          `  function describe() {`,
+          `    return $"{this.name}: {this.size}"`,
+          `  }`,
+          `}`,
+          '');
+        break;
+      case 2:
+        out.push(
+          `let config${id} = {`,
+          `  id = ${id}`,
+          `  title = "Config #${id}"  # shell-style comment`,
+          `  flags = [${id % 2 == 0 ? 'true, false' : 'false, true'}]`,
+          `  handler = @(x) x + ${id}`,
+          `}`,
+          '');
+        break;
+      case 3:
+        out.push(
+          `local function process${id}(data) {`,
+          `  let result = []`,
+          `  for (local i = 0; i < data.len(); i++) {`,
+          `    let value = accumulate${id - 3}(data[i], ${id})`,
+          `    if (value != null)`,
+          `      result.append(value)`,
+          `  }`,
+          `  return result.filter(@(v) v > ${id % 10})`,
+          `}`,
+          '');
+        break;
+    }
+  }
+  out.push(`return { config0 = config2, process = process3 }`);
+  return out.join('\n') + '\n';
+}
+
+function collectFiles(path, files) {
+  const stat = statSync(path);
+  if (stat.isDirectory()) {
+    for (const entry of readdirSync(path).sort()) {
+      if (entry.charAt(0) !== '.' && entry !== 'node_modules')
+        collectFiles(join(path, entry), files);
+    }
+  } else if (path.endsWith('.nut') || files.explicit) {
+    files.push({ name: relative(process.cwd(), path), source: readFileSync(path, 'utf8') });
+  }
+}
+
+// 1-based lines and 0-based columns of identifiers spread over the source
+function samplePositions(source) {
+  const positions = [];
+  const lines = source.split('\n');
+  const candidates = [];
+  lines.forEach((text, i) => {
+    const match = /\b[A-Za-z_][A-Za-z0-9_]*\b/.exec(text.replace(/\/\/.*$|#.*$|"[^"]*"/g, m => ' '.repeat(m.length)));
+    if (match)
+      candidates.push({ line: i + 1, col: match.index });
+  });
+  const count = Math.min(DECLARATION_SAMPLES, candidates.length);
+  for (let i = 0; i < count; ++i)
+    positions.push(candidates[Math.floor(i * candidates.length / count)]);
+  return positions;
+}
+
+function percentile(sorted, p) {
+  if (sorted.length === 0)
+    return 0;
+  return sorted[Math.min(sorted.length - 1, Math.round(p * (sorted.length - 1)))];
+}
+
+function summarize(ms, bytes) {
+  const sorted = ms.slice().sort((a, b) => a - b);
+  const p50 = percentile(sorted, 0.5);
+  return {
+    runs: ms.length,
+    p50, p90: percentile(sorted, 0.9), p99: percentile(sorted, 0.99), max: percentile(sorted, 1),
+    mbPerSec: p50 > 0 ? bytes / (1024 * 1024) / (p50 / 1000) : 0,
+  };
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const files = [];
+  for (const lines of options.sizes)
+    files.push({ name: `synthetic-${lines}.nut`, source: syntheticModule(lines), synthetic: true });
+  for (const path of options.paths) {
+    const found = [];
+    found.explicit = !statSync(path).isDirectory();
+    collectFiles(path, found);
+    files.push(...found);
+  }
+
+  if (options.writeCorpus) {
+    mkdirSync(options.writeCorpus, { recursive: true });
+    for (const file of files.filter(f => f.synthetic))
+      writeFileSync(join(options.writeCorpus, file.name), file.source);
+  }
+
+  if (!existsSync(WASM_JS)) {
+    console.error('out/quirrel-vscode.js not found. Run:  npm run compile:wasm');
+    process.exit(1);
+  }
+
+  const module = await (await import(pathToFileURL(WASM_JS).href)).default();
+  const heapBytes = () => module.HEAP8 ? module.HEAP8.buffer.byteLength : 0;
+  let peakHeap = heapBytes();
+
+  const phases = {
+    symbols: source => module.parseAndExtractSymbols(source),
+    analyze: source => module.analyzeCode(source),
+    tokens: source => module.extractSemanticTokens(source),
+  };
+
+  const results = [];
+  for (const file of files) {
+    const bytes = Buffer.byteLength(file.source, 'utf8');
+    const timings = { symbols: [], analyze: [], tokens: [], declaration: [] };
+    const positions = samplePositions(file.source);
+
+    for (let run = 0; run < options.runs; ++run) {
+      for (const [phase, fn] of Object.entries(phases)) {
+        const start = performance.now();
+        fn(file.source);
+        timings[phase].push(performance.now() - start);
+        peakHeap = Math.max(peakHeap, heapBytes());
+      }
+      for (const { line, col } of positions) {
+        const start = performance.now();
+        module.findDeclarationAt(file.source, line, col);
+        timings.declaration.push(performance.now() - start);
+      }
+      peakHeap = Math.max(peakHeap, heapBytes());
+    }
+
+    const phaseStats = {};
+    for (const [phase, ms] of Object.entries(timings)) {
+      if (ms.length > 0)
+        phaseStats[phase] = summarize(ms, bytes);
+    }
+    results.push({ file: file.name, lines: file.source.split('\n').length, bytes, phases: phaseStats });
+  }
+
+  if (options.json) {
+    console.log(JSON.stringify({ runs: options.runs, peakHeapBytes: peakHeap, files: results }, null, 2));
+    return;
+  }
+
+  const fmt = (v, w) => v.toFixed(3).padStart(w);
+  for (const result of results) {
+    console.log(`${result.file}: ${result.lines} lines, ${(result.bytes / 1024).toFixed(1)} KB`);
+    for (const [phase, s] of Object.entries(result.phases)) {
+      console.log(`  ${phase.padEnd(12)} p50 ${fmt(s.p50, 9)}  p90 ${fmt(s.p90, 9)}  p99 ${fmt(s.p99, 9)}  ` +
+        `max ${fmt(s.max, 9)} ms  ${s.mbPerSec.toFixed(2).padStart(8)} MB/s`);
+    }
+  }
+  console.log(`Peak WASM heap: ${(peakHeap / (1024 * 1024)).toFixed(1)} MB`);
+}
+
+main().catch(e => {
+  console.error(e);
+  process.exit(1);
+});
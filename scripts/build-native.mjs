@@ -0,0 +1,36 @@
+// Builds the engine as a Node-API addon for the current platform, into
+// out/native/<platform>-<arch>/quirrel-native.node. The extension uses it
+// instead of the WASM module when it is present.
+// Usage:
+//   node scripts/build-native.mjs
+// Node headers are taken from the running Node installation unless
+// NODE_API_INCLUDE_DIR is set; on Windows NODE_API_LIB must point to node.lib.
+
+import { existsSync, mkdirSync } from 'fs';
+import { dirname, join, resolve } from 'path';
+import { execSync } from 'child_process';
+
+const ROOT = resolve(import.meta.dirname, '..');
+const buildDir = join(ROOT, 'wasm', 'build-native');
+const outputDir = join(ROOT, 'out', 'native', `${process.platform}-${process.arch}`);
+
+const includeDir = process.env.NODE_API_INCLUDE_DIR ||
+  join(dirname(dirname(process.execPath)), 'include', 'node');
+if (!existsSync(join(includeDir, 'node_api.h'))) {
+  console.error(`node_api.h not found in ${includeDir}, set NODE_API_INCLUDE_DIR`);
+  process.exit(1);
+}
+
+mkdirSync(buildDir, { recursive: true });
+
+const defines = [
+  '-DQUIRREL_NAPI=ON',
+  '-DCMAKE_BUILD_TYPE=Release',
+  `-DNODE_API_INCLUDE_DIR="${includeDir}"`,
+  `-DQUIRREL_NAPI_OUTPUT_DIR="${outputDir}"`,
+];
+if (process.env.NODE_API_LIB)
+  defines.push(`-DNODE_API_LIB="${process.env.NODE_API_LIB}"`);
+
+execSync(`cmake ${defines.join(' ')} ..`, { cwd: buildDir, stdio: 'inherit' });
+execSync('cmake --build . --config Release --target quirrel-native', { cwd: buildDir, stdio: 'inherit' });
@@ -1,4 +1,9 @@
+// Usage:
+//   node scripts/build-wasm.mjs            # Release: -O3, LTO, SIMD, closure-compiled glue
+//   node scripts/build-wasm.mjs --debug    # Unoptimized, for debugging the engine
+//   node scripts/build-wasm.mjs --no-simd  # Release without WASM SIMD, for older hosts
 import { mkdirSync } from 'fs';
+import { cpus } from 'os';
 import { execSync } from 'child_process';
 
 const buildDir = 'wasm/build';
@@ -6,7 +11,11 @@ mkdirSync(buildDir, { recursive: true });
 
 const isWin = process.platform === 'win32';
 const generator = isWin ? 'NMake Makefiles' : 'Unix Makefiles';
-const make = isWin ? 'nmake' : 'make';
+const make = isWin ? 'nmake' : `make -j${cpus().length}`;
 
-execSync(`emcmake cmake -G "${generator}" ..`, { cwd: buildDir, stdio: 'inherit' });
+const buildType = process.argv.includes('--debug') ? 'Debug' : 'Release';
+const simd = process.argv.includes('--no-simd') ? 'OFF' : 'ON';
+
+execSync(`emcmake cmake -G "${generator}" -DCMAKE_BUILD_TYPE=${buildType} -DQUIRREL_WASM_SIMD=${simd} ..`,
+  { cwd: buildDir, stdio: 'inherit' });
 execSync(`emmake ${make}`, { cwd: buildDir, stdio: 'inherit' });
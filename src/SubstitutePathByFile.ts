@@ -8,22 +8,27 @@ import {
 
 const IGNORE_DIRS = ['node_modules', 'out', 'obj', 'bin', 'tmp'];
 
+// Entry types come with the listing, and subdirectories are walked
+// concurrently instead of one stat() after another
 async function findFile(dir: string, filter: string) {
   let fileList: { [key: string]: number } = {};
-  const files = await fs.readdir(dir);
-  for (const file of files) {
+  const entries = await fs.readdir(dir, { withFileTypes: true });
+  const subdirs: Promise<{ [key: string]: number }>[] = [];
+  for (const entry of entries) {
+    const file = entry.name;
     if (file.charAt(0) == '.' || IGNORE_DIRS.indexOf(file) >= 0)
       continue;
     const full = path.join(dir, file);
-    const stat = await fs.stat(full);
-    if (stat.isDirectory()) 
-      Object.assign(fileList, await findFile(full, filter));
-    else if (stat.isFile()) {
+    if (entry.isDirectory())
+      subdirs.push(findFile(full, filter));
+    else if (entry.isFile()) {
       const likeness = compareFileName(filter, file);
       if (likeness > 0)
         fileList[full] = likeness;
     }
   }
+  for (const found of await Promise.all(subdirs))
+    Object.assign(fileList, found);
   return fileList;
 }
 
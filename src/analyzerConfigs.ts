@@ -0,0 +1,71 @@
+import * as vs from 'vscode';
+import { promises as fs } from 'fs';
+import * as path from 'path';
+import { AnalyzerConfig, DocumentSource, forgetAnalyzerConfig } from './quirrelParser';
+
+const CONFIG_FILE_NAME = '.sqconfig';
+
+// Analyzer configs found in the directories above each document.
+// Every directory is looked at once and every config is read once; a file
+// watcher drops the affected entries when configs are added, edited or removed.
+export class AnalyzerConfigCache implements vs.Disposable {
+    // Config of a directory itself, null if it has none
+    private _configs: Map<string, Promise<AnalyzerConfig | null>> = new Map();
+    // Configs applying to a directory, outermost first
+    private _chains: Map<string, Promise<AnalyzerConfig[]>> = new Map();
+    private _nextVersion: number = 1;
+    private _disposables: vs.Disposable[] = [];
+
+    constructor() {
+        const watcher = vs.workspace.createFileSystemWatcher(`**/${CONFIG_FILE_NAME}`);
+        this._disposables.push(watcher);
+        this._disposables.push(watcher.onDidCreate(uri => this._invalidate(uri.fsPath)));
+        this._disposables.push(watcher.onDidChange(uri => this._invalidate(uri.fsPath)));
+        this._disposables.push(watcher.onDidDelete(uri => {
+            this._invalidate(uri.fsPath);
+            forgetAnalyzerConfig(uri.fsPath);
+        }));
+    }
+
+    // Resolver for quirrelParser.setAnalyzerConfigResolver
+    forDocument = (document: DocumentSource): Promise<AnalyzerConfig[]> => {
+        const fileName = document.fileName;
+        if (!fileName || !path.isAbsolute(fileName))
+            return Promise.resolve([]);
+        return this._chain(path.dirname(fileName));
+    }
+
+    dispose() {
+        this._disposables.forEach(d => d.dispose());
+    }
+
+    private _invalidate(configPath: string) {
+        this._configs.delete(path.dirname(configPath));
+        // Chains are cheap to rebuild from the directory entries that remain
+        this._chains.clear();
+    }
+
+    private _chain(dir: string): Promise<AnalyzerConfig[]> {
+        let chain = this._chains.get(dir);
+        if (!chain) {
+            const parent = path.dirname(dir);
+            const inherited: Promise<AnalyzerConfig[]> = parent !== dir ? this._chain(parent) : Promise.resolve([]);
+            chain = Promise.all([inherited, this._config(dir)]).then(([outer, own]) =>
+                own ? outer.concat(own) : outer);
+            this._chains.set(dir, chain);
+        }
+        return chain;
+    }
+
+    private _config(dir: string): Promise<AnalyzerConfig | null> {
+        let config = this._configs.get(dir);
+        if (!config) {
+            const file = path.join(dir, CONFIG_FILE_NAME);
+            config = fs.readFile(file, 'utf8').then(
+                text => ({ path: file, version: this._nextVersion++, text }),
+                () => null);
+            this._configs.set(dir, config);
+        }
+        return config;
+    }
+}
@@ -1,6 +1,6 @@
 import * as vs from 'vscode';
 import syntaxDiags from './syntaxDiags';
-import { isParserInitialized, analyzeCode, AnalysisResult } from './quirrelParser';
+import { isParserInitialized, documentAnalyze, AnalysisResult } from './quirrelParser';
 
 const ERRORCODE_UNUSED = [213, 221, 228];
 
@@ -40,7 +40,7 @@ function applyDiagnostics(document: vs.TextDocument, result: AnalysisResult) {
   return diagList.length;
 }
 
-export default function checkSyntaxOnSave(document: vs.TextDocument) {
+export default async function checkSyntaxOnSave(document: vs.TextDocument) {
   if (document.languageId !== 'quirrel')
     return;
 
@@ -54,11 +54,14 @@ export default function checkSyntaxOnSave(document: vs.TextDocument) {
     return;
   versionControl[srcPath] = version;
 
-  const result = analyzeCode(document.getText());
-  applyDiagnostics(document, result);
+  // A newer save supersedes this one if it did not start yet
+  const result = await documentAnalyze(document);
+  if (result && document.version === version) {
+    applyDiagnostics(document, result);
+  }
 }
 
-export function checkSyntaxCommand() {
+export async function checkSyntaxCommand() {
   const editor = vs.window.activeTextEditor;
   if (!editor) {
     vs.window.showWarningMessage('No active editor');
@@ -76,7 +79,10 @@ export function checkSyntaxCommand() {
     return;
   }
 
-  const result = analyzeCode(document.getText());
+  const result = await documentAnalyze(document);
+  if (!result) {
+    return;
+  }
   const count = applyDiagnostics(document, result);
 
   if (count === 0) {
@@ -1,6 +1,8 @@
 import * as vs from 'vscode';
-import { findDeclarationAt, isParserInitialized, DeclarationLocation } from './quirrelParser';
+import { documentFindDeclarationAt, isParserInitialized, DeclarationLocation } from './quirrelParser';
 import { extractRequirePath, extractImportPath, resolveModulePath } from './utils';
+import { WorkspaceIndex } from './workspaceIndex';
+import { symbolRange } from './documentSymbolProvider';
 
 function toRange(loc: DeclarationLocation): vs.Range {
     // Quirrel uses 1-based lines, VS Code uses 0-based
@@ -13,10 +15,27 @@ function toRange(loc: DeclarationLocation): vs.Range {
 }
 
 export class QuirrelDefinitionProvider implements vs.DefinitionProvider {
+    private readonly _index: WorkspaceIndex;
+
+    constructor(index: WorkspaceIndex) {
+        this._index = index;
+    }
+
+    // Locations of `name` exported by the module, or the module files themselves
+    private async _moduleTargets(document: vs.TextDocument, modulePath: string,
+                                 name: string | undefined): Promise<vs.LocationLink[]> {
+        const uris = await resolveModulePath(document.fileName, modulePath);
+        return Promise.all(uris.map(async uri => {
+            const symbol = name ? await this._index.findExport(uri, name) : undefined;
+            const targetRange = symbol ? symbolRange(symbol) : new vs.Range(0, 0, 0, 0);
+            return { targetUri: uri, targetRange };
+        }));
+    }
+
     async provideDefinition(
         document: vs.TextDocument,
         position: vs.Position,
-        _token: vs.CancellationToken
+        token: vs.CancellationToken
     ): Promise<vs.LocationLink[] | null> {
         // Module-path navigation: if the cursor is inside a string literal of
         // require("…"), import "…", or from "…" import …, jump to the file(s).
@@ -47,13 +66,23 @@ export class QuirrelDefinitionProvider implements vs.DefinitionProvider {
         const quirrelLine = position.line + 1;
         const quirrelCol = position.character;
 
-        const result = findDeclarationAt(document.getText(), quirrelLine, quirrelCol);
+        const result = await documentFindDeclarationAt(document, quirrelLine, quirrelCol, { token });
 
-        if (!result.found || !result.location) {
+        if (!result || !result.found || !result.location) {
             return null;
         }
 
-        const targetRange = toRange(result.location);
+        const location = result.location;
+
+        // Imported names, and names destructured as `let { a } = require("m")`,
+        // continue into the module they come from
+        if (location.module) {
+            const targets = await this._moduleTargets(document, location.module, location.name);
+            if (targets.length > 0)
+                return targets;
+        }
+
+        const targetRange = toRange(location);
         // originSelectionRange omitted — VS Code falls back to the word at the cursor.
         return [{
             targetUri: document.uri,
@@ -1,5 +1,10 @@
 import * as vs from 'vscode';
-import { parseAndExtractSymbols, isParserInitialized, QuirrelSymbol } from './quirrelParser';
+import { documentOutline, documentSymbols, isParserInitialized, QuirrelSymbol } from './quirrelParser';
+
+// Documents this long get an outline of the first levels only: top-level
+// declarations and the members and locals directly inside them
+const SHALLOW_OUTLINE_MIN_LINES = 20000;
+const SHALLOW_OUTLINE_DEPTH = 2;
 
 const KIND_MAP: Record<string, vs.SymbolKind> = {
     'Function': vs.SymbolKind.Function,
@@ -16,7 +21,11 @@ const KIND_MAP: Record<string, vs.SymbolKind> = {
     'Object': vs.SymbolKind.Object,
 };
 
-function toRange(sym: QuirrelSymbol): vs.Range {
+export function symbolKind(sym: QuirrelSymbol): vs.SymbolKind {
+    return KIND_MAP[sym.kind] ?? vs.SymbolKind.Null;
+}
+
+export function symbolRange(sym: QuirrelSymbol): vs.Range {
     // Quirrel uses 1-based lines, VS Code uses 0-based
     return new vs.Range(
         Math.max(0, sym.range.startLine - 1),
@@ -27,8 +36,8 @@ function toRange(sym: QuirrelSymbol): vs.Range {
 }
 
 function toDocumentSymbol(sym: QuirrelSymbol): vs.DocumentSymbol {
-    const range = toRange(sym);
-    const kind = KIND_MAP[sym.kind] ?? vs.SymbolKind.Null;
+    const range = symbolRange(sym);
+    const kind = symbolKind(sym);
 
     const symbol = new vs.DocumentSymbol(
         sym.name,
@@ -46,16 +55,21 @@ function toDocumentSymbol(sym: QuirrelSymbol): vs.DocumentSymbol {
 }
 
 export class QuirrelDocumentSymbolProvider implements vs.DocumentSymbolProvider {
-    provideDocumentSymbols(
+    async provideDocumentSymbols(
         document: vs.TextDocument,
-        _token: vs.CancellationToken
-    ): vs.ProviderResult<vs.DocumentSymbol[]> {
+        token: vs.CancellationToken
+    ): Promise<vs.DocumentSymbol[] | undefined> {
         if (!isParserInitialized()) {
             return [];
         }
 
-        const result = parseAndExtractSymbols(document.getText());
+        const result = document.lineCount >= SHALLOW_OUTLINE_MIN_LINES
+            ? await documentOutline(document, 0, SHALLOW_OUTLINE_DEPTH, { token })
+            : await documentSymbols(document, { token });
 
+        if (!result) {
+            return undefined;  // Cancelled
+        }
         if (result.error) {
             // Don't log parse errors - they're expected for incomplete code
             return [];
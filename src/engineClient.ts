@@ -0,0 +1,243 @@
+import * as path from 'path';
+import { promises as fs } from 'fs';
+import { Worker } from 'worker_threads';
+import {
+    atomics, cancelSlot, CompiledEngine, createCancelFlags, EngineBackend, EngineReply, EngineRequest, EngineWorkerData
+} from './engineProtocol';
+
+// Minimal view of vs.CancellationToken
+export interface CancellationTokenLike {
+    readonly isCancellationRequested: boolean;
+    onCancellationRequested(listener: () => any): { dispose(): any };
+}
+
+export interface RequestOptions {
+    token?: CancellationTokenLike;
+    // A new request with the same key cancels the previous one if it has not
+    // started yet. Document queries default to one key per method and document.
+    key?: string;
+}
+
+interface PendingRequest {
+    resolve(reply: EngineReply): void;
+    key?: string;
+}
+
+export function engineModulePath(extensionPath: string): string {
+    return path.join(extensionPath, 'out', 'quirrel-vscode.js');
+}
+
+// Node-API build of the engine for this platform, see scripts/build-native.mjs
+export function engineAddonPath(extensionPath: string): string {
+    return path.join(extensionPath, 'out', 'native', `${process.platform}-${process.arch}`, 'quirrel-native.node');
+}
+
+// WebAssembly is not part of the configured TypeScript libs
+const webAssembly: { compile(bytes: Uint8Array): Promise<CompiledEngine> } = (globalThis as any).WebAssembly;
+
+const compiledEngines: Map<string, Promise<CompiledEngine | undefined>> = new Map();
+
+// The .wasm next to wasmJsPath, compiled once per extension host and handed
+// to every worker, which then only instantiates it. V8 compiles in the
+// background, so this is started as early as possible. Undefined if it
+// cannot be compiled here; the workers then compile it themselves.
+export function compileEngine(wasmJsPath: string): Promise<CompiledEngine | undefined> {
+    let compiled = compiledEngines.get(wasmJsPath);
+    if (!compiled) {
+        compiled = fs.readFile(wasmJsPath.replace(/\.js$/, '.wasm'))
+            .then(bytes => webAssembly.compile(bytes))
+            .catch(() => undefined);
+        compiledEngines.set(wasmJsPath, compiled);
+    }
+    return compiled;
+}
+
+// One engine worker (engineWorker.ts) and the requests in flight to it
+export class EngineClient {
+    private readonly _wasmJsPath: string;
+    private readonly _nativeAddonPath: string | undefined;
+    private _worker: Worker | null = null;
+    private _backend: EngineBackend | undefined;
+    private _ready: boolean = false;
+    private _startPromise: Promise<void> | null = null;
+    // Posted while the compiled module is awaited, before the worker exists
+    private _queued: EngineRequest[] = [];
+    private _nextRequestId: number = 1;
+    private _pending: Map<number, PendingRequest> = new Map();
+    private _requestsByKey: Map<string, number> = new Map();
+    // Shared with the worker, reaches calls that already started
+    private _cancelFlags: Int32Array | undefined;
+
+    // Called once when the worker is gone, requests in flight fail
+    onExit: (() => void) | undefined;
+
+    // nativeAddonPath: addon to try before the WASM module. The addon keeps
+    // its state per process, so only one client should be given one.
+    constructor(wasmJsPath: string, nativeAddonPath?: string) {
+        this._wasmJsPath = wasmJsPath;
+        this._nativeAddonPath = nativeAddonPath;
+    }
+
+    start(): Promise<void> {
+        if (this._startPromise) {
+            return this._startPromise;
+        }
+
+        const started: Promise<void> = compileEngine(this._wasmJsPath).then(wasmModule => new Promise<void>((resolve, reject) => {
+            if (this._startPromise !== started) {
+                reject(new Error('Engine worker terminated'));
+                return;
+            }
+            this._cancelFlags = createCancelFlags();
+            const workerData: EngineWorkerData = {
+                wasmJsPath: this._wasmJsPath, nativeAddonPath: this._nativeAddonPath, wasmModule,
+                cancelFlags: this._cancelFlags };
+            const w = new Worker(path.join(__dirname, 'engineWorker.js'), { workerData });
+            this._worker = w;
+            for (const req of this._queued) {
+                w.postMessage(req);
+            }
+            this._queued = [];
+
+            w.on('message', (reply: EngineReply) => {
+                switch (reply.type) {
+                    case 'ready':
+                        this._ready = true;
+                        this._backend = reply.backend;
+                        resolve();
+                        break;
+                    case 'initError':
+                        reject(new Error(reply.message));
+                        w.terminate();
+                        break;
+                    default:
+                        this._settle(reply);
+                        break;
+                }
+            });
+            w.on('error', e => reject(e));
+            w.on('exit', () => {
+                reject(new Error('Engine worker exited'));
+                this._reset();
+            });
+        }));
+        this._startPromise = started;
+
+        return this._startPromise;
+    }
+
+    isReady(): boolean {
+        return this._ready;
+    }
+
+    // Engine build the worker loaded, once it is ready
+    get backend(): EngineBackend | undefined {
+        return this._backend;
+    }
+
+    // Requests waiting for an answer
+    get load(): number {
+        return this._pending.size;
+    }
+
+    terminate() {
+        const w = this._worker;
+        this._reset();
+        if (w) {
+            w.terminate();
+        }
+    }
+
+    // Fire-and-forget message, ordered with the calls
+    post(req: EngineRequest) {
+        if (this._worker) {
+            this._worker.postMessage(req);
+        } else if (this._startPromise) {
+            this._queued.push(req);
+        }
+    }
+
+    call(method: string, args: any[], options: RequestOptions = {},
+         doc?: { id: number; version: number }): Promise<EngineReply> {
+        const id = this._nextRequestId++;
+        if (!this._startPromise) {
+            return Promise.resolve({ type: 'error', id, message: 'Parser not initialized. Call initParser() first.' });
+        }
+        if (options.token && options.token.isCancellationRequested) {
+            return Promise.resolve({ type: 'cancelled', id });
+        }
+
+        return new Promise<EngineReply>(resolve => {
+            const { key, token } = options;
+            if (key !== undefined) {
+                const previous = this._requestsByKey.get(key);
+                if (previous !== undefined) {
+                    this._cancel(previous);
+                }
+                this._requestsByKey.set(key, id);
+            }
+
+            const subscription = token ? token.onCancellationRequested(() => this._cancel(id)) : undefined;
+            this._pending.set(id, {
+                key,
+                resolve: reply => {
+                    if (subscription) {
+                        subscription.dispose();
+                    }
+                    resolve(reply);
+                },
+            });
+            this.post({ type: 'call', id, method, args, doc });
+        });
+    }
+
+    // Forget everything tied to the worker
+    private _reset() {
+        if (!this._startPromise) {
+            return;
+        }
+        this._worker = null;
+        this._cancelFlags = undefined;
+        this._queued = [];
+        this._ready = false;
+        this._backend = undefined;
+        this._startPromise = null;
+        this._requestsByKey.clear();
+        const pending = this._pending;
+        this._pending = new Map();
+        for (const [id, request] of pending) {
+            request.resolve({ type: 'error', id, message: 'Engine worker exited' });
+        }
+        if (this.onExit) {
+            this.onExit();
+        }
+    }
+
+    private _settle(reply: EngineReply) {
+        if (!('id' in reply)) {
+            return;
+        }
+        const pending = this._pending.get(reply.id);
+        if (!pending) {
+            return;
+        }
+        this._pending.delete(reply.id);
+        if (pending.key !== undefined && this._requestsByKey.get(pending.key) === reply.id) {
+            this._requestsByKey.delete(pending.key);
+        }
+        pending.resolve(reply);
+    }
+
+    private _cancel(id: number) {
+        if (!this._pending.has(id)) {
+            return;
+        }
+        this.post({ type: 'cancel', id });
+        // The queued call is dropped by the message, a running one sees the flag
+        if (this._cancelFlags && atomics) {
+            atomics.store(this._cancelFlags, cancelSlot(id), id);
+        }
+        // Don't wait for the worker, the result is not used either way
+        this._settle({ type: 'cancelled', id });
+    }
+}
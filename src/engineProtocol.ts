@@ -0,0 +1,89 @@
+// Messages between the extension host (quirrelParser.ts) and the engine
+// worker (engineWorker.ts). Requests are processed strictly in the order
+// they were posted, so document updates always apply before later queries.
+
+// Editor change with 1-based lines, as taken by the native editDocument
+export interface EngineEdit {
+    startLine: number;
+    startChar: number;
+    endLine: number;
+    endChar: number;
+    text: string;
+}
+
+export type EngineRequest =
+    | { type: 'open'; docId: number; version: number; text: string }
+    | { type: 'update'; docId: number; version: number; text: string }
+    | { type: 'edit'; docId: number; version: number; edits: EngineEdit[] }
+    | { type: 'close'; docId: number }
+    // Register an analyzer config by path for later analysis calls, null text drops it
+    | { type: 'config'; path: string; text: string | null }
+    // doc: session the call reads, answered with 'stale' if it is not at that version
+    | { type: 'call'; id: number; method: string; args: any[]; doc?: { id: number; version: number } }
+    // Drop a queued call. A call that already started is told through the
+    // cancel flags instead and stops at the engine's next poll.
+    | { type: 'cancel'; id: number }
+    // Attach an EngineProfile to every following result
+    | { type: 'profiling'; enabled: boolean }
+    // Cap on the memory of document caches, 0 for none (setMemoryBudget in wasm/engine.h)
+    | { type: 'memoryBudget'; megabytes: number }
+    // Documents shown in editors, kept when others are evicted; replaces the previous set
+    | { type: 'pinned'; docIds: number[] };
+
+// Where one call spent its time, in ms; heap sizes in bytes (wasm/profile.h)
+export interface EngineProfile {
+    parse: number;
+    walk: number;
+    sort: number;
+    serialize: number;
+    analyze: number;
+    heapPeak: number;
+    heapInUse: number;
+    call: number;  // Whole native call as seen by the worker
+    copy: number;  // Copying binary results out of the WASM heap
+}
+
+export type EngineReply =
+    | { type: 'ready'; backend: EngineBackend }
+    | { type: 'initError'; message: string }
+    | { type: 'result'; id: number; result: any; profile?: EngineProfile }
+    | { type: 'error'; id: number; message: string }
+    | { type: 'cancelled'; id: number }
+    | { type: 'stale'; id: number };
+
+// Engine build a worker runs: the Node-API addon or the WASM module
+export type EngineBackend = 'native' | 'wasm';
+
+// A compiled WebAssembly.Module, opaque here. Workers of the same process
+// can share it through workerData without compiling again.
+export type CompiledEngine = object;
+
+export interface EngineWorkerData {
+    wasmJsPath: string;
+    // Node-API addon tried before the WASM module, if set
+    nativeAddonPath?: string;
+    // Compiled engine to instantiate instead of compiling wasmJsPath's .wasm
+    wasmModule?: CompiledEngine;
+    // Over a SharedArrayBuffer, see CANCEL_SLOTS
+    cancelFlags?: Int32Array;
+}
+
+// Layout of the cancel flags shared by the host, the worker and the engine
+// (wasm/cancel.h): [0] is the id of the call the engine is running, set by
+// the worker, and the host cancels a call by storing its id in cancelSlot(id).
+export const CANCEL_SLOTS = 64;
+
+export function cancelSlot(id: number): number {
+    return 1 + id % CANCEL_SLOTS;
+}
+
+// Atomics and SharedArrayBuffer are not part of the configured TypeScript libs
+export const atomics: {
+    load(array: Int32Array, index: number): number;
+    store(array: Int32Array, index: number, value: number): number;
+} | undefined = (globalThis as any).Atomics;
+
+export function createCancelFlags(): Int32Array | undefined {
+    const shared = (globalThis as any).SharedArrayBuffer;
+    return shared && atomics ? new Int32Array(new shared(4 * (1 + CANCEL_SLOTS))) : undefined;
+}
@@ -0,0 +1,124 @@
+import * as vs from 'vscode';
+import { CallProfile, engineMemoryStats, isParserInitialized, setMemoryBudget, setProfileListener } from './quirrelParser';
+import { dbgOutputChannel } from './utils';
+
+// Samples kept per operation for the statistics table
+const WINDOW_SIZE = 100;
+
+const ENGINE_PHASES = ['parse', 'walk', 'sort', 'serialize', 'analyze', 'call', 'copy'] as const;
+
+// Timings of one operation in ms by phase, heap sizes in bytes
+type Sample = { [phase: string]: number };
+
+const samples: Map<string, Sample[]> = new Map();
+let enabled = false;
+
+export function isProfilingEnabled(): boolean {
+    return enabled;
+}
+
+function record(operation: string, sample: Sample) {
+    let list = samples.get(operation);
+    if (!list) {
+        list = [];
+        samples.set(operation, list);
+    }
+    list.push(sample);
+    if (list.length > WINDOW_SIZE)
+        list.shift();
+}
+
+function pad(text: string, width: number, left: boolean): string {
+    const fill = ' '.repeat(Math.max(0, width - text.length));
+    return left ? text + fill : fill + text;
+}
+
+function formatPhases(sample: Sample): string {
+    return Object.keys(sample)
+        .filter(phase => !phase.startsWith('heap') && sample[phase] > 0)
+        .map(phase => `${phase} ${sample[phase].toFixed(2)}`)
+        .join(', ');
+}
+
+function onEngineCall(profile: CallProfile) {
+    const sample: Sample = { roundTrip: profile.roundTrip, convert: profile.convert };
+    for (const phase of ENGINE_PHASES)
+        sample[phase] = profile.engine[phase];
+    sample.heapPeak = profile.engine.heapPeak;
+    record(profile.method, sample);
+
+    dbgOutputChannel.appendLine(`[profile] ${profile.method}: ${formatPhases(sample)} ms, ` +
+        `heap peak ${(profile.engine.heapPeak / 1024).toFixed(0)} KB`);
+}
+
+// Extension-side work that follows an engine call, e.g. building decorations
+export function recordTiming(operation: string, ms: number) {
+    if (!enabled)
+        return;
+    record(operation, { total: ms });
+    dbgOutputChannel.appendLine(`[profile] ${operation}: ${ms.toFixed(2)} ms`);
+}
+
+export function setProfilingEnabled(enable: boolean) {
+    enabled = enable;
+    setProfileListener(enable ? onEngineCall : null);
+}
+
+export function updateProfilingFromConfig() {
+    setProfilingEnabled(vs.workspace.getConfiguration('quirrel.engine').get<boolean>('profiling', false));
+}
+
+export function updateMemoryBudgetFromConfig() {
+    setMemoryBudget(vs.workspace.getConfiguration('quirrel.engine').get<number>('memoryBudgetMB', 256));
+}
+
+const mb = (bytes: number) => `${(bytes / (1024 * 1024)).toFixed(1)} MB`;
+
+async function showMemoryStats() {
+    const stats = isParserInitialized() ? await engineMemoryStats() : undefined;
+    if (!stats)
+        return;
+    dbgOutputChannel.appendLine(`Engine memory: ${mb(stats.documentBytes)} in ${stats.documents.length} documents` +
+        ` (budget ${stats.budget > 0 ? mb(stats.budget) : 'none'}), ${stats.evictions} evictions`);
+    if (stats.heapSize > 0)
+        dbgOutputChannel.appendLine(`  heap ${mb(stats.heapInUse)} in use of ${mb(stats.heapSize)}`);
+    dbgOutputChannel.appendLine(`  scratch arena ${mb(stats.scratchArena)}, ${stats.idleVms} idle VMs`);
+    for (const doc of stats.documents) {
+        const state = doc.pinned ? 'visible' : doc.parsed ? 'parsed' : 'text only';
+        dbgOutputChannel.appendLine(`  ${pad(mb(doc.bytes), 9, false)}  ${state}  ${doc.uri ?? `#${doc.id}`}`);
+    }
+}
+
+// Memory held by the engine, then median and 95th percentile of each phase
+// over the recent samples
+export async function showEngineStats() {
+    dbgOutputChannel.show(true);
+    await showMemoryStats();
+    if (samples.size === 0) {
+        dbgOutputChannel.appendLine(enabled
+            ? 'No engine calls profiled yet'
+            : 'Engine profiling is off, enable quirrel.engine.profiling to collect statistics');
+        return;
+    }
+
+    const pct = (sorted: number[], p: number) => sorted[Math.min(sorted.length - 1, Math.round(p * (sorted.length - 1)))];
+    const rows: string[][] = [['operation', 'phase', 'count', 'p50', 'p95', 'max']];
+    for (const [operation, list] of [...samples].sort((a, b) => a[0].localeCompare(b[0]))) {
+        for (const phase of Object.keys(list[0])) {
+            const values = list.map(s => s[phase]).sort((a, b) => a - b);
+            if (values[values.length - 1] <= 0)
+                continue;
+            const fmt = phase.startsWith('heap')
+                ? (v: number) => `${(v / 1024).toFixed(0)} KB`
+                : (v: number) => `${v.toFixed(2)} ms`;
+            rows.push([operation, phase, `${values.length}`,
+                fmt(pct(values, 0.5)), fmt(pct(values, 0.95)), fmt(values[values.length - 1])]);
+        }
+    }
+
+    const widths = rows[0].map((_, c) => Math.max(...rows.map(r => r[c].length)));
+    dbgOutputChannel.appendLine(`Engine statistics, last ${WINDOW_SIZE} samples per operation:`);
+    for (const row of rows) {
+        dbgOutputChannel.appendLine(row.map((cell, c) => pad(cell, widths[c], c < 2)).join('  '));
+    }
+}
@@ -0,0 +1,298 @@
+// Worker thread hosting the Quirrel WASM engine, so that parsing and
+// analysis never block the extension host. See engineProtocol.ts.
+import { parentPort, workerData } from 'worker_threads';
+import { existsSync } from 'fs';
+import {
+    atomics, cancelSlot, CompiledEngine, EngineBackend, EngineReply, EngineRequest, EngineWorkerData
+} from './engineProtocol';
+
+type WasmModule = { [method: string]: (...args: any[]) => any };
+
+const port = parentPort!;
+let wasmModule: WasmModule | null = null;
+
+// Text version each native session currently holds, -1 if unknown
+const sessionVersions: Map<number, number> = new Map();
+
+const queue: EngineRequest[] = [];
+let drainScheduled = false;
+let profiling = false;
+// Shared with the host, see CANCEL_SLOTS
+const cancelFlags = (workerData as EngineWorkerData).cancelFlags;
+// Sessions marked pinned in the engine
+const pinnedSessions: Set<number> = new Set();
+
+function post(reply: EngineReply, transfer?: ArrayBuffer[]) {
+    port.postMessage(reply, transfer);
+}
+
+// The addon exports the same functions as the WASM module. It can be
+// missing for this platform, or in use by another worker (see wasm/napi.cpp).
+function loadAddon(addonPath: string | undefined): WasmModule | null {
+    if (!addonPath || !existsSync(addonPath)) {
+        return null;
+    }
+    try {
+        return require(addonPath);
+    } catch (e) {
+        return null;
+    }
+}
+
+// Emscripten hook instantiating a module compiled by the extension host
+// (see compileEngine in engineClient.ts) instead of fetching and compiling
+function moduleOptions(compiled: CompiledEngine | undefined): object {
+    if (!compiled) {
+        return {};
+    }
+    const webAssembly = (globalThis as any).WebAssembly;
+    return {
+        instantiateWasm(imports: object, receive: (instance: object, module: object) => void) {
+            webAssembly.instantiate(compiled, imports).then(
+                (instance: object) => receive(instance, compiled),
+                (e: any) => post({ type: 'initError', message: `Failed to instantiate WASM module: ${e}` }));
+            return {};
+        },
+    };
+}
+
+async function loadModule(wasmJsPath: string, compiled?: CompiledEngine): Promise<WasmModule> {
+    try {
+        // Dynamic import for ES module
+        const moduleFactory = await import(wasmJsPath);
+        return await moduleFactory.default(moduleOptions(compiled));
+    } catch (e) {
+        // Fallback: try require for CommonJS compatibility
+        try {
+            const moduleFactory = require(wasmJsPath);
+            return await moduleFactory(moduleOptions(compiled));
+        } catch (e2) {
+            throw new Error(`Failed to load WASM module: ${e}`);
+        }
+    }
+}
+
+// Binary results are objects of typed array views into the WASM heap.
+// Copy them out so they can be transferred, other fields pass as they are.
+function unpackViews(view: { [field: string]: any } | null) {
+    const transfer: ArrayBuffer[] = [];
+    if (!view) {
+        return { result: null, transfer };
+    }
+    const result: { [field: string]: any } = {};
+    for (const field of Object.keys(view)) {
+        const value = view[field];
+        if (ArrayBuffer.isView(value)) {
+            const copy = (value as Int32Array).slice();
+            transfer.push(copy.buffer as ArrayBuffer);
+            result[field] = copy;
+        } else {
+            result[field] = value;
+        }
+    }
+    return { result, transfer };
+}
+
+const BINARY_METHODS = new Set([
+    'documentAnalyzeBinary', 'documentSemanticTokensBinary', 'documentSemanticTokensRangeBinary',
+    'documentSemanticTokensDelta', 'processBatch']);
+
+// Run a call with its id published to the engine, which polls the host's
+// cancel flag for it
+function callEngine(module: WasmModule, fn: (...args: any[]) => any, req: Extract<EngineRequest, { type: 'call' }>) {
+    if (!cancelFlags || !atomics) {
+        return fn.apply(module, req.args);
+    }
+    atomics.store(cancelFlags, 0, req.id);
+    if (typeof module.takeCallCancelled === 'function') {
+        // Left over from a call that threw
+        module.takeCallCancelled();
+    }
+    try {
+        return fn.apply(module, req.args);
+    } finally {
+        atomics.store(cancelFlags, 0, 0);
+    }
+}
+
+// The call stopped early on its cancel flag. One that finished is answered
+// with its result even if the flag was set meanwhile; the host drops it if
+// it has already settled the call. Engines without takeCallCancelled only
+// have the flag to go by.
+function stoppedEarly(module: WasmModule, req: Extract<EngineRequest, { type: 'call' }>): boolean {
+    if (!cancelFlags || !atomics) {
+        return false;
+    }
+    if (typeof module.takeCallCancelled === 'function') {
+        return module.takeCallCancelled();
+    }
+    return atomics.load(cancelFlags, cancelSlot(req.id)) === req.id;
+}
+
+function handle(module: WasmModule, req: EngineRequest) {
+    switch (req.type) {
+        case 'open':
+            module.openDocument(req.docId, req.text);
+            sessionVersions.set(req.docId, req.version);
+            break;
+
+        case 'update':
+            module.updateDocument(req.docId, req.text);
+            sessionVersions.set(req.docId, req.version);
+            break;
+
+        case 'edit': {
+            // Edits are only valid on top of the version right before them
+            if (sessionVersions.get(req.docId) !== req.version - 1) {
+                sessionVersions.set(req.docId, -1);
+                break;
+            }
+            for (const e of req.edits) {
+                if (!module.editDocument(req.docId, e.startLine, e.startChar, e.endLine, e.endChar, e.text)) {
+                    sessionVersions.set(req.docId, -1);
+                    return;
+                }
+            }
+            sessionVersions.set(req.docId, req.version);
+            break;
+        }
+
+        case 'close':
+            module.closeDocument(req.docId);
+            sessionVersions.delete(req.docId);
+            pinnedSessions.delete(req.docId);
+            break;
+
+        case 'config':
+            if (req.text === null) {
+                module.removeAnalyzerConfig(req.path);
+            } else {
+                module.setAnalyzerConfig(req.path, req.text);
+            }
+            break;
+
+        case 'call': {
+            if (req.doc && sessionVersions.get(req.doc.id) !== req.doc.version) {
+                post({ type: 'stale', id: req.id });
+                break;
+            }
+            try {
+                const fn = module[req.method];
+                if (typeof fn !== 'function') {
+                    throw new Error(`Unknown engine method ${req.method}`);
+                }
+                const started = profiling ? performance.now() : 0;
+                const value = callEngine(module, fn, req);
+                const called = profiling ? performance.now() : 0;
+                if (stoppedEarly(module, req)) {
+                    post({ type: 'cancelled', id: req.id });
+                    break;
+                }
+                let reply: Extract<EngineReply, { type: 'result' }>;
+                let transfer: ArrayBuffer[] | undefined;
+                if (BINARY_METHODS.has(req.method)) {
+                    const unpacked = unpackViews(value);
+                    reply = { type: 'result', id: req.id, result: unpacked.result };
+                    transfer = unpacked.transfer;
+                } else {
+                    reply = { type: 'result', id: req.id, result: value };
+                }
+                if (profiling) {
+                    const native = JSON.parse(module.takeProfile());
+                    reply.profile = { ...native, call: called - started, copy: performance.now() - called };
+                }
+                post(reply, transfer);
+            } catch (e) {
+                post({ type: 'error', id: req.id, message: `${e}` });
+            }
+            break;
+        }
+
+        case 'profiling':
+            profiling = req.enabled;
+            module.setProfilingEnabled(req.enabled);
+            break;
+
+        case 'memoryBudget':
+            module.setMemoryBudget(req.megabytes);
+            break;
+
+        case 'pinned': {
+            const pinned = new Set(req.docIds);
+            for (const docId of pinnedSessions) {
+                if (!pinned.has(docId))
+                    module.setDocumentPinned(docId, false);
+            }
+            for (const docId of pinned) {
+                if (!pinnedSessions.has(docId))
+                    module.setDocumentPinned(docId, true);
+            }
+            pinnedSessions.clear();
+            pinned.forEach(docId => pinnedSessions.add(docId));
+            break;
+        }
+
+        case 'cancel':
+            break;
+    }
+}
+
+// One request per macrotask, so that cancellations posted meanwhile are
+// received before the next queued call starts
+function drain() {
+    drainScheduled = false;
+    const req = queue.shift();
+    if (req && wasmModule) {
+        handle(wasmModule, req);
+    }
+    scheduleDrain();
+}
+
+function scheduleDrain() {
+    if (!drainScheduled && wasmModule && queue.length > 0) {
+        drainScheduled = true;
+        setImmediate(drain);
+    }
+}
+
+port.on('message', (req: EngineRequest) => {
+    if (req.type === 'cancel') {
+        const index = queue.findIndex(q => q.type === 'call' && q.id === req.id);
+        if (index >= 0) {
+            queue.splice(index, 1);
+            post({ type: 'cancelled', id: req.id });
+        }
+        return;
+    }
+    queue.push(req);
+    scheduleDrain();
+});
+
+async function loadEngine(data: EngineWorkerData): Promise<{ module: WasmModule; backend: EngineBackend }> {
+    const addon = loadAddon(data.nativeAddonPath);
+    if (addon) {
+        return { module: addon, backend: 'native' };
+    }
+    return { module: await loadModule(data.wasmJsPath, data.wasmModule), backend: 'wasm' };
+}
+
+// The addon reads the flags' memory itself, WASM code through Module.cancelFlags
+function shareCancelFlags(module: WasmModule) {
+    if (!cancelFlags) {
+        return;
+    }
+    if (typeof module.setCancelFlags === 'function') {
+        module.setCancelFlags(cancelFlags);
+    } else {
+        (module as any).cancelFlags = cancelFlags;
+    }
+}
+
+loadEngine(workerData as EngineWorkerData).then(({ module, backend }) => {
+    shareCancelFlags(module);
+    wasmModule = module;
+    post({ type: 'ready', backend });
+    scheduleDrain();
+}).catch(e => {
+    post({ type: 'initError', message: `${e instanceof Error ? e.message : e}` });
+});
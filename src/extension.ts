@@ -5,10 +5,19 @@ import { SubstituteValueByKey } from './SubstituteValueByKey';
 import runDocumentCode from './runDocumentCode';
 import checkSyntaxOnSave, { checkSyntaxCommand } from './checkSyntaxOnSave';
 import clearDiagsOnClose from './clearDiagsOnClose';
-import { initParser } from './quirrelParser';
+import {
+  initParser, shutdownParser, setRestartListener, applyDocumentChanges, closeDocument, setAnalyzerConfigResolver,
+  parserBackend, setVisibleDocuments
+} from './quirrelParser';
 import { QuirrelDocumentSymbolProvider } from './documentSymbolProvider';
 import { QuirrelDefinitionProvider } from './definitionProvider';
+import { QuirrelReferenceProvider, QuirrelRenameProvider } from './referenceProvider';
 import { QuirrelSemanticHighlighter } from './semanticHighlighter';
+import { QuirrelSemanticTokensProvider, SEMANTIC_TOKENS_LEGEND } from './semanticTokensProvider';
+import { QuirrelWorkspaceSymbolProvider } from './workspaceSymbolProvider';
+import { WorkspaceIndex } from './workspaceIndex';
+import { AnalyzerConfigCache } from './analyzerConfigs';
+import { showEngineStats, updateMemoryBudgetFromConfig, updateProfilingFromConfig } from './engineStats';
 import { dbgOutputChannel } from './utils';
 
 const DOCUMENT: vs.DocumentSelector = { language: 'quirrel', scheme: 'file' };
@@ -19,20 +28,70 @@ export async function activate(context: vs.ExtensionContext) {
     DOCUMENT, new QuirrelDocumentSymbolProvider());
   context.subscriptions.push(symbolProvider);
 
+  // Outline of all workspace modules, parsed by its own worker pool and
+  // cached in workspace storage between sessions
+  const workspaceIndex = new WorkspaceIndex(context.extensionPath, context.storagePath);
+  context.subscriptions.push(workspaceIndex);
+  if (WorkspaceIndex.isEnabled())
+    workspaceIndex.start();
+
   // Register definition provider (Go To Declaration)
   const definitionProvider: vs.Disposable = vs.languages.registerDefinitionProvider(
-    DOCUMENT, new QuirrelDefinitionProvider());
+    DOCUMENT, new QuirrelDefinitionProvider(workspaceIndex));
   context.subscriptions.push(definitionProvider);
 
+  // Find All References and Rename of symbols within a document
+  context.subscriptions.push(vs.languages.registerReferenceProvider(
+    DOCUMENT, new QuirrelReferenceProvider()));
+  context.subscriptions.push(vs.languages.registerRenameProvider(
+    DOCUMENT, new QuirrelRenameProvider()));
+
+  const workspaceSymbolProvider: vs.Disposable = vs.languages.registerWorkspaceSymbolProvider(
+    new QuirrelWorkspaceSymbolProvider(workspaceIndex));
+  context.subscriptions.push(workspaceSymbolProvider);
+
   // Register semantic highlighter (decoration-based, theme-aware)
   const semanticHighlighter = new QuirrelSemanticHighlighter();
   context.subscriptions.push(semanticHighlighter);
 
-  // Initialize WASM parser (non-blocking, symbols work after load)
-  initParser(context.extensionPath).then(() => {
-    //dbgOutputChannel.appendLine('WASM parser initialized successfully');
+  // Token types for theme colors, updated by edits against the previous result
+  const semanticTokensProvider = new QuirrelSemanticTokensProvider();
+  context.subscriptions.push(semanticTokensProvider);
+  context.subscriptions.push(vs.languages.registerDocumentSemanticTokensProvider(
+    DOCUMENT, semanticTokensProvider, SEMANTIC_TOKENS_LEGEND));
+
+  // .sqconfig files of the directories above each analyzed document
+  const analyzerConfigs = new AnalyzerConfigCache();
+  context.subscriptions.push(analyzerConfigs);
+  setAnalyzerConfigResolver(analyzerConfigs.forDocument);
+
+  // Opt-in timing of engine calls, logged to the output channel
+  updateProfilingFromConfig();
+  context.subscriptions.push(vs.workspace.onDidChangeConfiguration(e => {
+    if (e.affectsConfiguration('quirrel.engine.profiling'))
+      updateProfilingFromConfig();
+    if (e.affectsConfiguration('quirrel.engine.memoryBudgetMB'))
+      updateMemoryBudgetFromConfig();
+  }));
+
+  // Documents in visible editors keep their engine caches when over budget
+  updateMemoryBudgetFromConfig();
+  setVisibleDocuments(vs.window.visibleTextEditors.map(editor => editor.document));
+  context.subscriptions.push(vs.window.onDidChangeVisibleTextEditors(
+    editors => setVisibleDocuments(editors.map(editor => editor.document))));
+
+  // Start the WASM engine worker (non-blocking, symbols work after load)
+  const useNativeAddon = vs.workspace.getConfiguration('quirrel.engine').get<boolean>('useNativeAddon', true);
+  setRestartListener(() => {
+    dbgOutputChannel.appendLine('Quirrel engine restarted');
+    semanticHighlighter.refresh();
+    semanticTokensProvider.refresh();
+  });
+  initParser(context.extensionPath, useNativeAddon).then(() => {
+    dbgOutputChannel.appendLine(`Quirrel engine loaded (${parserBackend() === 'native' ? 'native addon' : 'WASM'})`);
     // Trigger semantic highlighting now that WASM is ready
     semanticHighlighter.refresh();
+    semanticTokensProvider.refresh();
   }).catch(err => {
     dbgOutputChannel.appendLine(`WASM parser initialization failed: ${err}`);
     dbgOutputChannel.appendLine('Document symbols will not be available.');
@@ -53,10 +112,18 @@ export async function activate(context: vs.ExtensionContext) {
     'quirrel.editor.action.checkSyntax', checkSyntaxCommand);
   context.subscriptions.push(commandCheckSyntax);
 
+  const commandShowEngineStats: vs.Disposable = vs.commands.registerCommand(
+    'quirrel.engine.showStats', showEngineStats);
+  context.subscriptions.push(commandShowEngineStats);
+
   context.subscriptions.push(vs.workspace.onDidSaveTextDocument(checkSyntaxOnSave));
   context.subscriptions.push(vs.workspace.onDidCloseTextDocument(clearDiagsOnClose));
+  context.subscriptions.push(vs.workspace.onDidChangeTextDocument(
+    e => applyDocumentChanges(e.document, e.contentChanges)));
+  context.subscriptions.push(vs.workspace.onDidCloseTextDocument(closeDocument));
 }
 
 export function deactivate() {
+  shutdownParser();
   return undefined;
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+import * as crypto from 'crypto';
+import { promises as fs } from 'fs';
+import * as path from 'path';
+import { QuirrelSymbol } from './quirrelParser';
+
+// Binary cache of module outlines between sessions.
+//
+// Layout (little-endian):
+//   "QSIX" u32 formatVersion  str engineVersion
+//   u16 kindCount  str kind * kindCount
+//   u32 entryCount
+//   entry * entryCount:
+//     str path  f64 mtimeMs  f64 size  u8[20] sha1(content)
+//     u32 symbolBytes  symbol * (u32 count, then recursively)
+//   symbol: str name  u16 kind  u32 startLine startCol endLine endCol  u32 childCount  symbol * childCount
+//   str: u32 byteLength, utf8 bytes
+//
+// The file is read with a single read; only the entry table is decoded up
+// front, symbol blobs are decoded when a module is looked up.
+
+const MAGIC = 0x58495351;  // "QSIX"
+const FORMAT_VERSION = 2;
+const HASH_BYTES = 20;
+
+export interface FileStamp {
+    mtimeMs: number;
+    size: number;
+    hash: Buffer;  // sha1 of the content
+}
+
+export function hashContent(content: string | Buffer): Buffer {
+    return crypto.createHash('sha1').update(content).digest();
+}
+
+interface CachedEntry {
+    stamp: FileStamp;
+    offset: number;  // Symbol blob in the cache buffer
+}
+
+class Reader {
+    pos: number = 0;
+    readonly buf: Buffer;
+
+    constructor(buf: Buffer) {
+        this.buf = buf;
+    }
+
+    u16(): number { const v = this.buf.readUInt16LE(this.pos); this.pos += 2; return v; }
+    u32(): number { const v = this.buf.readUInt32LE(this.pos); this.pos += 4; return v; }
+    f64(): number { const v = this.buf.readDoubleLE(this.pos); this.pos += 8; return v; }
+    bytes(n: number): Buffer { const v = this.buf.subarray(this.pos, this.pos + n); this.pos += n; return v; }
+    str(): string { const n = this.u32(); return this.buf.toString('utf8', this.pos, this.pos += n); }
+}
+
+class Writer {
+    private _chunks: Buffer[] = [];
+    private _cur: Buffer = Buffer.allocUnsafe(64 * 1024);
+    private _pos: number = 0;
+
+    private _reserve(n: number) {
+        if (this._pos + n <= this._cur.length)
+            return;
+        this._chunks.push(this._cur.subarray(0, this._pos));
+        this._cur = Buffer.allocUnsafe(Math.max(64 * 1024, n));
+        this._pos = 0;
+    }
+
+    u16(v: number) { this._reserve(2); this._cur.writeUInt16LE(v, this._pos); this._pos += 2; }
+    u32(v: number) { this._reserve(4); this._cur.writeUInt32LE(v, this._pos); this._pos += 4; }
+    f64(v: number) { this._reserve(8); this._cur.writeDoubleLE(v, this._pos); this._pos += 8; }
+    bytes(b: Buffer) { this._reserve(b.length); b.copy(this._cur, this._pos); this._pos += b.length; }
+    str(s: string) {
+        const b = Buffer.from(s, 'utf8');
+        this.u32(b.length);
+        this.bytes(b);
+    }
+
+    finish(): Buffer {
+        this._chunks.push(this._cur.subarray(0, this._pos));
+        return Buffer.concat(this._chunks);
+    }
+}
+
+export class IndexCache {
+    private _buf: Buffer | null = null;
+    private _kinds: string[] = [];
+    private _entries: Map<string, CachedEntry> = new Map();
+
+    readonly file: string;
+    readonly engineVersion: string;
+
+    constructor(file: string, engineVersion: string) {
+        this.file = file;
+        this.engineVersion = engineVersion;
+    }
+
+    get size(): number {
+        return this._entries.size;
+    }
+
+    // Read the cache file, an unreadable or outdated cache is simply empty
+    async load() {
+        let buf: Buffer;
+        try {
+            buf = await fs.readFile(this.file);
+        } catch (e) {
+            return;
+        }
+
+        try {
+            const r = new Reader(buf);
+            if (r.u32() !== MAGIC || r.u32() !== FORMAT_VERSION || r.str() !== this.engineVersion)
+                return;
+
+            const kinds: string[] = [];
+            for (let n = r.u16(); n > 0; --n)
+                kinds.push(r.str());
+
+            const entries: Map<string, CachedEntry> = new Map();
+            for (let n = r.u32(); n > 0; --n) {
+                const key = r.str();
+                const mtimeMs = r.f64();
+                const size = r.f64();
+                const hash = r.bytes(HASH_BYTES);
+                const symbolBytes = r.u32();
+                entries.set(key, { stamp: { mtimeMs, size, hash }, offset: r.pos });
+                r.pos += symbolBytes;
+            }
+            if (r.pos > buf.length)
+                return;
+
+            this._buf = buf;
+            this._kinds = kinds;
+            this._entries = entries;
+        } catch (e) {
+            // Truncated file
+        }
+    }
+
+    stamp(key: string): FileStamp | undefined {
+        const entry = this._entries.get(key);
+        return entry ? entry.stamp : undefined;
+    }
+
+    symbols(key: string): QuirrelSymbol[] | undefined {
+        const entry = this._entries.get(key);
+        if (!entry || !this._buf)
+            return undefined;
+
+        const r = new Reader(this._buf);
+        r.pos = entry.offset;
+        const kinds = this._kinds;
+        const readSymbols = (): QuirrelSymbol[] => {
+            const list: QuirrelSymbol[] = [];
+            for (let n = r.u32(); n > 0; --n) {
+                const name = r.str();
+                const kind = kinds[r.u16()];
+                const range = { startLine: r.u32(), startCol: r.u32(), endLine: r.u32(), endCol: r.u32() };
+                const children = readSymbols();
+                list.push(children.length > 0 ? { name, kind, range, children } : { name, kind, range });
+            }
+            return list;
+        };
+        return readSymbols();
+    }
+
+    // Replace the cache file with the given modules
+    static async save(file: string, engineVersion: string,
+                      modules: Iterable<[string, FileStamp, QuirrelSymbol[]]>) {
+        const kindIds: Map<string, number> = new Map();
+        const body = new Writer();
+        let count = 0;
+
+        const writeSymbols = (w: Writer, symbols: QuirrelSymbol[]) => {
+            w.u32(symbols.length);
+            for (const sym of symbols) {
+                let kind = kindIds.get(sym.kind);
+                if (kind === undefined) {
+                    kind = kindIds.size;
+                    kindIds.set(sym.kind, kind);
+                }
+                w.str(sym.name);
+                w.u16(kind);
+                w.u32(Math.max(0, sym.range.startLine));
+                w.u32(Math.max(0, sym.range.startCol));
+                w.u32(Math.max(0, sym.range.endLine));
+                w.u32(Math.max(0, sym.range.endCol));
+                writeSymbols(w, sym.children || []);
+            }
+        };
+
+        for (const [key, stamp, symbols] of modules) {
+            const blob = new Writer();
+            writeSymbols(blob, symbols);
+            const bytes = blob.finish();
+
+            body.str(key);
+            body.f64(stamp.mtimeMs);
+            body.f64(stamp.size);
+            body.bytes(stamp.hash);
+            body.u32(bytes.length);
+            body.bytes(bytes);
+            ++count;
+        }
+
+        const head = new Writer();
+        head.u32(MAGIC);
+        head.u32(FORMAT_VERSION);
+        head.str(engineVersion);
+        head.u16(kindIds.size);
+        for (const kind of kindIds.keys())
+            head.str(kind);
+        head.u32(count);
+
+        // Write aside and rename, so a crash never leaves a torn cache
+        await fs.mkdir(path.dirname(file), { recursive: true });
+        const tmp = `${file}.${process.pid}.tmp`;
+        await fs.writeFile(tmp, Buffer.concat([head.finish(), body.finish()]));
+        await fs.rename(tmp, file);
+    }
+}
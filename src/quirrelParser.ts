@@ -1,4 +1,5 @@
-import * as path from 'path';
+import { EngineBackend, EngineEdit, EngineProfile, EngineReply, EngineRequest } from './engineProtocol';
+import { CancellationTokenLike, EngineClient, RequestOptions, engineAddonPath, engineModulePath } from './engineClient';
 
 export interface SymbolRange {
     startLine: number;
@@ -12,6 +13,9 @@ export interface QuirrelSymbol {
     kind: string;
     range: SymbolRange;
     children?: QuirrelSymbol[];
+    // Set on collapsed symbols of documentOutline that have children
+    id?: number;
+    hasChildren?: boolean;
 }
 
 export interface ParseResult {
@@ -40,6 +44,8 @@ export interface DeclarationLocation {
     endLine: number; // 1-based
     endCol: number;  // 0-based
     kind: string;
+    module?: string;  // Imports and bindings destructured from require(): module path as written
+    name?: string;    // Selective imports and require() bindings: name of the symbol in that module
 }
 
 export interface FindDeclarationResult {
@@ -47,6 +53,22 @@ export interface FindDeclarationResult {
     location?: DeclarationLocation;
 }
 
+export interface SourceRange {
+    line: number;    // 1-based
+    col: number;     // 0-based
+    endLine: number; // 1-based
+    endCol: number;  // 0-based
+}
+
+export interface FindReferencesResult {
+    found: boolean;
+    name?: string;
+    kind?: string;
+    renamable?: boolean;         // Declaration located and not a selective import without alias
+    declaration?: SourceRange;   // Name in the declaration
+    references?: SourceRange[];  // Uses in this document, in position order
+}
+
 export interface SemanticToken {
     line: number;      // 1-based
     col: number;       // 0-based
@@ -59,104 +81,554 @@ export interface SemanticTokensResult {
     tokens: SemanticToken[];
 }
 
-interface QuirrelWasmModule {
-    parseAndExtractSymbols(source: string): string;
-    analyzeCode(source: string): string;
-    findDeclarationAt(source: string, line: number, col: number): string;
-    extractSemanticTokens(source: string): string;
+export interface DeclarationReference {
+    line: number;    // 1-based
+    col: number;     // 0-based
+    endLine: number; // 1-based
+    endCol: number;  // 0-based
+    decl: DeclarationLocation;
 }
 
-let wasmModule: QuirrelWasmModule | null = null;
-let initPromise: Promise<void> | null = null;
+// Everything the engine knows about a document, from a single parse
+export interface DocumentAnalysis {
+    error: string | null;
+    symbols: QuirrelSymbol[];
+    tokens: SemanticToken[];
+    declarations: DeclarationReference[];
+    messages: DiagnosticItem[];
+}
 
-export async function initParser(extensionPath: string): Promise<void> {
-    if (wasmModule) {
-        return;
+// Semantic tokens in the delta-encoded layout of vs.SemanticTokens:
+// 5 ints per token (deltaLine, deltaStartChar, length, type, modifiers), 0-based lines.
+// nameIds[i] indexes nameHashes with the identifier of token i (-1 if unknown).
+// nameHashes are int32 hashes of the identifier texts, see wasm/document.h.
+export interface PackedSemanticTokens {
+    data: Int32Array;
+    nameIds: Int32Array;
+    nameHashes: Int32Array;
+}
+
+// Token data against the caller's previous result, as vs.SemanticTokensEdit:
+// data replaces deleteCount ints from start. full: data is the whole array.
+export interface SemanticTokensDelta {
+    resultId: number;
+    full: boolean;
+    start: number;
+    deleteCount: number;
+    data: Int32Array;
+}
+
+// Lines of interest for range-limited token requests, 0-based and inclusive
+export interface LineRange {
+    startLine: number;
+    endLine: number;
+}
+
+// Minimal view of vs.TextDocument, keeps this module free of the vscode API
+export interface DocumentSource {
+    readonly uri: { toString(): string };
+    readonly fileName?: string;
+    readonly version: number;
+    getText(): string;
+}
+
+// Minimal view of vs.TextDocumentContentChangeEvent (0-based positions)
+export interface DocumentChange {
+    readonly range: {
+        readonly start: { readonly line: number; readonly character: number };
+        readonly end: { readonly line: number; readonly character: number };
+    };
+    readonly text: string;
+}
+
+export { CancellationTokenLike, RequestOptions };
+
+// Analyzer config file (.sqconfig); version changes whenever the text does
+export interface AnalyzerConfig {
+    path: string;
+    version: number;
+    text: string;
+}
+
+// Configs applying to a document, outermost directory first
+export type AnalyzerConfigResolver = (document: DocumentSource) => Promise<AnalyzerConfig[]>;
+
+// Timings of one engine call, reported while profiling is on
+export interface CallProfile {
+    method: string;
+    engine: EngineProfile;
+    roundTrip: number;  // ms from posting the call to receiving the reply
+    convert: number;    // ms decoding the result on this side
+}
+
+export type ProfileListener = (profile: CallProfile) => void;
+
+interface DocumentHandle {
+    id: number;
+    version: number;  // Version last sent to the engine, -1 to resend the text
+}
+
+// Engine worker owning the document sessions
+let engine: EngineClient | null = null;
+
+// Native parse sessions of open documents, keyed by document URI
+const documentHandles: Map<string, DocumentHandle> = new Map();
+let nextDocumentId = 1;
+
+let analyzerConfigResolver: AnalyzerConfigResolver | null = null;
+// Config versions the engine holds, keyed by path
+const sentAnalyzerConfigs: Map<string, number> = new Map();
+
+let profileListener: ProfileListener | null = null;
+
+let memoryBudgetMb = 0;
+// URIs of the documents shown in editors
+let visibleDocuments: Set<string> = new Set();
+
+// A worker that died is restarted after a delay, doubled on every exit up
+// to the maximum. One that ran long enough starts over at the first delay.
+const RESTART_DELAY_MS = 1000;
+const MAX_RESTART_DELAY_MS = 60000;
+const RESTART_STABLE_MS = 60000;
+// Arguments of initParser, null after shutdownParser
+let parserOptions: { extensionPath: string; useNativeAddon: boolean } | null = null;
+let engineStarted = 0;
+let restartDelayMs = RESTART_DELAY_MS;
+let restartTimer: NodeJS.Timeout | undefined;
+let restartListener: (() => void) | null = null;
+
+// Start the engine worker. The engine is loaded and run there, so no parse
+// or analysis ever blocks the extension host. With useNativeAddon the
+// Node-API build is used when one exists for this platform, WASM otherwise.
+export async function initParser(extensionPath: string, useNativeAddon: boolean = true): Promise<void> {
+    parserOptions = { extensionPath, useNativeAddon };
+    if (!engine) {
+        const client = new EngineClient(engineModulePath(extensionPath),
+            useNativeAddon ? engineAddonPath(extensionPath) : undefined);
+        client.onExit = () => {
+            // Sessions died with the worker
+            if (engine === client) {
+                engine = null;
+                documentHandles.clear();
+                sentAnalyzerConfigs.clear();
+                scheduleRestart();
+            }
+        };
+        engine = client;
+        engineStarted = Date.now();
+    }
+    const started = engine.start();
+    if (profileListener) {
+        post({ type: 'profiling', enabled: true });
+    }
+    if (memoryBudgetMb > 0) {
+        post({ type: 'memoryBudget', megabytes: memoryBudgetMb });
     }
+    return started;
+}
 
-    if (initPromise) {
-        return initPromise;
+// Report timings of every engine call to listener, null turns profiling off
+export function setProfileListener(listener: ProfileListener | null) {
+    if ((listener !== null) !== (profileListener !== null)) {
+        post({ type: 'profiling', enabled: listener !== null });
     }
+    profileListener = listener;
+}
 
-    initPromise = (async () => {
-        const wasmJsPath = path.join(extensionPath, 'out', 'quirrel-vscode.js');
+export function isParserInitialized(): boolean {
+    return engine !== null && engine.isReady();
+}
 
-        try {
-            // Dynamic import for ES module
-            const moduleFactory = await import(wasmJsPath);
-            wasmModule = await moduleFactory.default();
-        } catch (e) {
-            // Fallback: try require for CommonJS compatibility
-            try {
-                const moduleFactory = require(wasmJsPath);
-                wasmModule = await moduleFactory();
-            } catch (e2) {
-                throw new Error(`Failed to load WASM module: ${e}`);
-            }
+export function parserBackend(): EngineBackend | undefined {
+    return engine ? engine.backend : undefined;
+}
+
+export function shutdownParser() {
+    parserOptions = null;
+    if (restartTimer) {
+        clearTimeout(restartTimer);
+        restartTimer = undefined;
+    }
+    if (engine) {
+        engine.terminate();
+    }
+}
+
+// Called when a worker restarted after an exit is ready, null for none
+export function setRestartListener(listener: (() => void) | null) {
+    restartListener = listener;
+}
+
+function scheduleRestart() {
+    if (!parserOptions || restartTimer) {
+        return;
+    }
+    const delay = Date.now() - engineStarted >= RESTART_STABLE_MS ? RESTART_DELAY_MS : restartDelayMs;
+    restartDelayMs = Math.min(delay * 2, MAX_RESTART_DELAY_MS);
+    restartTimer = setTimeout(() => {
+        restartTimer = undefined;
+        if (!parserOptions || engine) {
+            return;
         }
-    })();
+        // A failed start exits the worker, which schedules the next attempt
+        initParser(parserOptions.extensionPath, parserOptions.useNativeAddon).then(() => {
+            if (restartListener)
+                restartListener();
+        }, () => undefined);
+    }, delay);
+}
 
-    return initPromise;
+// Cap on the memory the engine spends on caches of open documents, 0 for none.
+// Over it, the least recently used documents are reparsed on their next query.
+export function setMemoryBudget(megabytes: number) {
+    memoryBudgetMb = Math.max(0, Math.floor(megabytes));
+    post({ type: 'memoryBudget', megabytes: memoryBudgetMb });
 }
 
-export function isParserInitialized(): boolean {
-    return wasmModule !== null;
+// Documents whose caches stay when over the memory budget
+export function setVisibleDocuments(documents: readonly DocumentSource[]) {
+    visibleDocuments = new Set(documents.map(document => document.uri.toString()));
+    postPinnedDocuments();
 }
 
-export function parseAndExtractSymbols(source: string): ParseResult {
-    if (!wasmModule) {
-        return {
-            error: 'Parser not initialized. Call initParser() first.',
-            symbols: []
-        };
+function postPinnedDocuments() {
+    const docIds: number[] = [];
+    visibleDocuments.forEach(key => {
+        const handle = documentHandles.get(key);
+        if (handle)
+            docIds.push(handle.id);
+    });
+    post({ type: 'pinned', docIds });
+}
+
+export interface DocumentMemory {
+    id: number;
+    uri?: string;
+    bytes: number;
+    parsed: boolean;
+    pinned: boolean;
+}
+
+// Sizes in bytes, see memoryStats in wasm/engine.h; heap sizes are 0 for the native addon
+export interface EngineMemoryStats {
+    budget: number;
+    documentBytes: number;
+    heapSize: number;
+    heapInUse: number;
+    scratchArena: number;
+    idleVms: number;
+    evictions: number;
+    documents: DocumentMemory[];
+}
+
+export function engineMemoryStats(): Promise<EngineMemoryStats | undefined> {
+    return callValue('memoryStats', [], () => undefined, json => {
+        const stats = JSON.parse(json) as EngineMemoryStats;
+        const uris: Map<number, string> = new Map();
+        documentHandles.forEach((handle, key) => uris.set(handle.id, key));
+        for (const doc of stats.documents)
+            doc.uri = uris.get(doc.id);
+        return stats;
+    });
+}
+
+export function setAnalyzerConfigResolver(resolver: AnalyzerConfigResolver | null) {
+    analyzerConfigResolver = resolver;
+}
+
+// Drop a config the engine may hold, after its file was deleted
+export function forgetAnalyzerConfig(path: string) {
+    if (sentAnalyzerConfigs.delete(path)) {
+        post({ type: 'config', path, text: null });
     }
+}
 
+// Send the document's configs the engine does not have yet,
+// and return them in the form analysis calls take
+async function analyzerConfigChain(document: DocumentSource): Promise<string> {
+    if (!analyzerConfigResolver) {
+        return '';
+    }
+    let configs: AnalyzerConfig[];
     try {
-        const jsonResult = wasmModule.parseAndExtractSymbols(source);
-        return JSON.parse(jsonResult) as ParseResult;
+        configs = await analyzerConfigResolver(document);
     } catch (e) {
-        return {
-            error: `Parse error: ${e}`,
-            symbols: []
-        };
+        return '';
     }
+    for (const config of configs) {
+        if (sentAnalyzerConfigs.get(config.path) !== config.version) {
+            post({ type: 'config', path: config.path, text: config.text });
+            sentAnalyzerConfigs.set(config.path, config.version);
+        }
+    }
+    return configs.map(config => config.path).join('\n');
 }
 
-export function analyzeCode(source: string): AnalysisResult {
-    if (!wasmModule) {
-        return { messages: [] };
+function post(req: EngineRequest) {
+    if (engine) {
+        engine.post(req);
     }
+}
 
-    try {
-        const jsonResult = wasmModule.analyzeCode(source);
-        return JSON.parse(jsonResult) as AnalysisResult;
-    } catch (e) {
-        return { messages: [] };
+function call(method: string, args: any[], options: RequestOptions = {},
+              doc?: { id: number; version: number }): Promise<EngineReply> {
+    if (!engine) {
+        return Promise.resolve({ type: 'error', id: 0, message: 'Parser not initialized. Call initParser() first.' });
     }
+    return engine.call(method, args, options, doc);
 }
 
-export function findDeclarationAt(source: string, line: number, col: number): FindDeclarationResult {
-    if (!wasmModule) {
-        return { found: false };
+function convertResult<T>(method: string, reply: Extract<EngineReply, { type: 'result' }>, posted: number,
+                          convert: (result: any) => T): T {
+    if (!profileListener || !reply.profile) {
+        return convert(reply.result);
     }
+    const received = performance.now();
+    const value = convert(reply.result);
+    profileListener({ method, engine: reply.profile, roundTrip: received - posted, convert: performance.now() - received });
+    return value;
+}
 
+// Result of a call on a standalone source string, fallback on failure
+async function callValue<T>(method: string, args: any[], fallback: (error: string) => T,
+                            convert: (result: any) => T): Promise<T> {
+    const posted = performance.now();
+    const reply = await call(method, args);
+    if (reply.type !== 'result') {
+        return fallback(reply.type === 'error' ? reply.message : 'Request cancelled');
+    }
     try {
-        const jsonResult = wasmModule.findDeclarationAt(source, line, col);
-        return JSON.parse(jsonResult) as FindDeclarationResult;
+        return convertResult(method, reply, posted, convert);
     } catch (e) {
-        return { found: false };
+        return fallback(`${e}`);
     }
 }
 
-export function extractSemanticTokens(source: string): SemanticTokensResult {
-    if (!wasmModule) {
-        return { tokens: [] };
+// Make the native session match the current document version.
+// The text is only sent over when the document has changed.
+function syncDocument(document: DocumentSource): DocumentHandle {
+    const key = document.uri.toString();
+    const handle = documentHandles.get(key);
+
+    if (!handle) {
+        const created = { id: nextDocumentId++, version: document.version };
+        post({ type: 'open', docId: created.id, version: created.version, text: document.getText() });
+        documentHandles.set(key, created);
+        if (visibleDocuments.has(key))
+            postPinnedDocuments();
+        return created;
     }
 
-    try {
-        const jsonResult = wasmModule.extractSemanticTokens(source);
-        return JSON.parse(jsonResult) as SemanticTokensResult;
-    } catch (e) {
-        return { tokens: [] };
+    if (handle.version !== document.version) {
+        post({ type: 'update', docId: handle.id, version: document.version, text: document.getText() });
+        handle.version = document.version;
+    }
+    return handle;
+}
+
+// Query the document's session. Resolves to undefined if the request was
+// cancelled or superseded, and to fallback if it failed.
+async function documentCall<T>(document: DocumentSource, method: string, args: any[],
+                               options: RequestOptions, fallback: (error: string) => T,
+                               convert: (result: any) => T): Promise<T | undefined> {
+    if (!engine) {
+        return fallback('Parser not initialized. Call initParser() first.');
+    }
+
+    const opts = { key: `${method}:${document.uri.toString()}`, ...options };
+    // One retry: the session misses if incremental edits could not be applied
+    for (let attempt = 0; attempt < 2; ++attempt) {
+        const handle = syncDocument(document);
+        const posted = performance.now();
+        const reply = await call(method, [handle.id, ...args], opts, { id: handle.id, version: document.version });
+
+        switch (reply.type) {
+            case 'result':
+                try {
+                    return convertResult(method, reply, posted, convert);
+                } catch (e) {
+                    return fallback(`${e}`);
+                }
+            case 'stale':
+                handle.version = -1;
+                continue;
+            case 'cancelled':
+                return undefined;
+            case 'error':
+                return fallback(reply.message);
+        }
+    }
+    return fallback('Document is out of sync');
+}
+
+export function parseAndExtractSymbols(source: string): Promise<ParseResult> {
+    return callValue('parseAndExtractSymbols', [source],
+        error => ({ error: `Parse error: ${error}`, symbols: [] }),
+        json => JSON.parse(json) as ParseResult);
+}
+
+export function analyzeCode(source: string): Promise<AnalysisResult> {
+    return callValue('analyzeCode', [source],
+        () => ({ messages: [] }),
+        json => JSON.parse(json) as AnalysisResult);
+}
+
+export function findDeclarationAt(source: string, line: number, col: number): Promise<FindDeclarationResult> {
+    return callValue('findDeclarationAt', [source, line, col],
+        () => ({ found: false }),
+        json => JSON.parse(json) as FindDeclarationResult);
+}
+
+export function extractSemanticTokens(source: string): Promise<SemanticTokensResult> {
+    return callValue('extractSemanticTokens', [source],
+        () => ({ tokens: [] }),
+        json => JSON.parse(json) as SemanticTokensResult);
+}
+
+// Only tokens on the given lines; scopes are still resolved from the file start
+export function extractSemanticTokensRange(source: string, range: LineRange): Promise<SemanticTokensResult> {
+    return callValue('extractSemanticTokensRange', [source, range.startLine + 1, range.endLine + 1],
+        () => ({ tokens: [] }),
+        json => JSON.parse(json) as SemanticTokensResult);
+}
+
+// Forward editor changes to the native session instead of resending the
+// whole text. Falls back to a full update on the next query if the session
+// is not exactly one version behind.
+export function applyDocumentChanges(document: DocumentSource, changes: readonly DocumentChange[]) {
+    const handle = documentHandles.get(document.uri.toString());
+    if (!handle || !engine || handle.version !== document.version - 1) {
+        return;
+    }
+
+    const edits: EngineEdit[] = changes.map(change => ({
+        startLine: change.range.start.line + 1,
+        startChar: change.range.start.character,
+        endLine: change.range.end.line + 1,
+        endChar: change.range.end.character,
+        text: change.text,
+    }));
+    // The worker checks the edit applies on top of the session's version
+    // and answers later queries with 'stale' otherwise
+    post({ type: 'edit', docId: handle.id, version: document.version, edits });
+    handle.version = document.version;
+}
+
+export function closeDocument(document: DocumentSource) {
+    const key = document.uri.toString();
+    const handle = documentHandles.get(key);
+    if (!handle) {
+        return;
     }
+
+    documentHandles.delete(key);
+    post({ type: 'close', docId: handle.id });
+}
+
+export function documentSymbols(document: DocumentSource, options: RequestOptions = {}): Promise<ParseResult | undefined> {
+    return documentCall(document, 'documentSymbols', [], options,
+        error => ({ error: `Parse error: ${error}`, symbols: [] }),
+        json => JSON.parse(json) as ParseResult);
+}
+
+// Symbols depth levels deep below the collapsed symbol parentId, or below
+// the top level for 0. Collapsed symbols keep their id until the text changes.
+export function documentOutline(document: DocumentSource, parentId: number, depth: number,
+                                options: RequestOptions = {}): Promise<ParseResult | undefined> {
+    return documentCall(document, 'documentOutline', [parentId, depth], options,
+        error => ({ error: `Parse error: ${error}`, symbols: [] }),
+        json => JSON.parse(json) as ParseResult);
+}
+
+// Diagnostics in the engine's struct-of-arrays layout: per message i,
+// strings[6i..6i+5] are (offset, byte length) in pool of message, textId and file
+interface PackedDiagnostics {
+    line: Int32Array;
+    col: Int32Array;
+    len: Int32Array;
+    intId: Int32Array;
+    isError: Int32Array;
+    strings: Int32Array;
+    pool: Uint8Array;
+}
+
+const utf8Decoder = new TextDecoder();
+
+function decodeDiagnostics(packed: PackedDiagnostics | null): AnalysisResult {
+    if (!packed) {
+        return { messages: [] };
+    }
+    const { strings, pool } = packed;
+    const str = (i: number, which: number) => {
+        const at = i * 6 + which * 2;
+        return utf8Decoder.decode(pool.subarray(strings[at], strings[at] + strings[at + 1]));
+    };
+
+    const messages: DiagnosticItem[] = new Array(packed.line.length);
+    for (let i = 0; i < messages.length; ++i) {
+        messages[i] = {
+            line: packed.line[i],
+            col: packed.col[i],
+            len: packed.len[i],
+            file: str(i, 2),
+            intId: packed.intId[i],
+            textId: str(i, 1),
+            message: str(i, 0),
+            isError: packed.isError[i] !== 0,
+        };
+    }
+    return { messages };
+}
+
+export async function documentAnalyze(document: DocumentSource, options: RequestOptions = {}): Promise<AnalysisResult | undefined> {
+    const configChain = await analyzerConfigChain(document);
+    return documentCall(document, 'documentAnalyzeBinary', [configChain], options,
+        () => ({ messages: [] }),
+        result => decodeDiagnostics(result as PackedDiagnostics | null));
+}
+
+export async function documentAnalyzeAll(document: DocumentSource, options: RequestOptions = {}): Promise<DocumentAnalysis | undefined> {
+    const configChain = await analyzerConfigChain(document);
+    return documentCall(document, 'documentAnalyzeAll', [configChain], options,
+        error => ({ error: `Parse error: ${error}`, symbols: [], tokens: [], declarations: [], messages: [] }),
+        json => JSON.parse(json) as DocumentAnalysis);
+}
+
+export function documentFindDeclarationAt(document: DocumentSource, line: number, col: number,
+                                          options: RequestOptions = {}): Promise<FindDeclarationResult | undefined> {
+    return documentCall(document, 'documentFindDeclarationAt', [line, col], options,
+        () => ({ found: false }),
+        json => JSON.parse(json) as FindDeclarationResult);
+}
+
+export function documentFindReferences(document: DocumentSource, line: number, col: number,
+                                       options: RequestOptions = {}): Promise<FindReferencesResult | undefined> {
+    return documentCall(document, 'documentFindReferences', [line, col], options,
+        () => ({ found: false }),
+        json => JSON.parse(json) as FindReferencesResult);
+}
+
+export function documentSemanticTokens(document: DocumentSource, options: RequestOptions = {}): Promise<SemanticTokensResult | undefined> {
+    return documentCall(document, 'documentSemanticTokens', [], options,
+        () => ({ tokens: [] }),
+        json => JSON.parse(json) as SemanticTokensResult);
+}
+
+// Tokens of the whole document, or only of the lines in range.
+// Buffers are copied out of the WASM heap by the worker and transferred.
+export function documentSemanticTokensBinary(document: DocumentSource, range?: LineRange,
+                                             options: RequestOptions = {}): Promise<PackedSemanticTokens | null | undefined> {
+    const convert = (view: PackedSemanticTokens | null) => view;
+    return range
+        ? documentCall(document, 'documentSemanticTokensRangeBinary', [range.startLine + 1, range.endLine + 1], options,
+            () => null, convert)
+        : documentCall(document, 'documentSemanticTokensBinary', [], options,
+            () => null, convert);
+}
+
+// previousResultId: resultId of the last delta the caller applied, 0 for none
+export function documentSemanticTokensDelta(document: DocumentSource, previousResultId: number,
+                                            options: RequestOptions = {}): Promise<SemanticTokensDelta | null | undefined> {
+    return documentCall(document, 'documentSemanticTokensDelta', [previousResultId], options,
+        () => null, result => result as SemanticTokensDelta | null);
 }
@@ -0,0 +1,76 @@
+import * as vs from 'vscode';
+import { documentFindReferences, isParserInitialized, FindReferencesResult, SourceRange } from './quirrelParser';
+
+const IDENTIFIER_PATTERN = /^[A-Za-z_][A-Za-z0-9_]*$/;
+
+function toRange(loc: SourceRange): vs.Range {
+    // Quirrel uses 1-based lines, VS Code uses 0-based
+    return new vs.Range(
+        Math.max(0, loc.line - 1),
+        Math.max(0, loc.col),
+        Math.max(0, loc.endLine - 1),
+        Math.max(0, loc.endCol)
+    );
+}
+
+async function findReferences(document: vs.TextDocument, position: vs.Position,
+                              token: vs.CancellationToken): Promise<FindReferencesResult | undefined> {
+    if (!isParserInitialized())
+        return undefined;
+    const result = await documentFindReferences(document, position.line + 1, position.character, { token });
+    return result && result.found ? result : undefined;
+}
+
+// Declaration first, then the uses in document order
+function symbolRanges(result: FindReferencesResult, includeDeclaration: boolean): vs.Range[] {
+    const ranges = (result.references || []).map(toRange);
+    if (includeDeclaration && result.declaration)
+        ranges.unshift(toRange(result.declaration));
+    return ranges;
+}
+
+// Find All References within the document. The engine keeps the use ->
+// declaration edges of each document version, so repeated queries after
+// the first one are index lookups.
+export class QuirrelReferenceProvider implements vs.ReferenceProvider {
+    async provideReferences(document: vs.TextDocument, position: vs.Position,
+                            context: vs.ReferenceContext, token: vs.CancellationToken): Promise<vs.Location[] | null> {
+        const result = await findReferences(document, position, token);
+        if (!result)
+            return null;
+        return symbolRanges(result, context.includeDeclaration).map(range => new vs.Location(document.uri, range));
+    }
+}
+
+// Renames a local symbol at its declaration and all of its uses in the document
+export class QuirrelRenameProvider implements vs.RenameProvider {
+    async prepareRename(document: vs.TextDocument, position: vs.Position,
+                        token: vs.CancellationToken): Promise<{ range: vs.Range; placeholder: string }> {
+        const result = await findReferences(document, position, token);
+        if (!result || !result.name)
+            throw new Error('No symbol to rename at this position');
+        if (!result.renamable)
+            throw new Error(`'${result.name}' cannot be renamed here`);
+
+        const range = symbolRanges(result, true).find(r => r.contains(position))
+                   ?? document.getWordRangeAtPosition(position);
+        if (!range)
+            throw new Error('No symbol to rename at this position');
+        return { range, placeholder: result.name };
+    }
+
+    async provideRenameEdits(document: vs.TextDocument, position: vs.Position, newName: string,
+                             token: vs.CancellationToken): Promise<vs.WorkspaceEdit | null> {
+        if (!IDENTIFIER_PATTERN.test(newName))
+            throw new Error(`'${newName}' is not a valid identifier`);
+
+        const result = await findReferences(document, position, token);
+        if (!result || !result.renamable)
+            return null;
+
+        const edit = new vs.WorkspaceEdit();
+        for (const range of symbolRanges(result, true))
+            edit.replace(document.uri, range, newName);
+        return edit;
+    }
+}
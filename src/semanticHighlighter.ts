@@ -1,6 +1,7 @@
 import * as vs from 'vscode';
-import { extractSemanticTokens, isParserInitialized } from './quirrelParser';
+import { documentSemanticTokensBinary, isParserInitialized, LineRange, PackedSemanticTokens } from './quirrelParser';
 import { dbgOutputChannel } from './utils';
+import { isProfilingEnabled, recordTiming } from './engineStats';
 
 // Token type indices (must match C++ enum order)
 const TT_VARIABLE = 0;
@@ -13,11 +14,17 @@ const TT_ENUM = 4;
 const TT_IMPORT = 7;
 
 // We colorize local identifiers and imports
-// Classes, enums, properties keep their TextMate colors
+// Classes, enums, properties keep their theme colors (see semanticTokensProvider.ts)
 
 // Default number of distinct colors in the auto-generated palette
 const DEFAULT_PALETTE_SIZE = 12;
 
+// Documents longer than this get the visible lines highlighted first,
+// the rest follows in a second request
+const VIEWPORT_FIRST_MIN_LINES = 3000;
+// Extra lines around the viewport for the first pass, so small scrolls stay colored
+const VIEWPORT_MARGIN_LINES = 100;
+
 // Generate a color palette based on theme type
 function generatePalette(isDark: boolean, size: number, saturation: number): string[] {
     const colors: string[] = [];
@@ -33,17 +40,6 @@ function generatePalette(isDark: boolean, size: number, saturation: number): str
     return colors;
 }
 
-// Hash a string to get a consistent index
-function hashString(str: string): number {
-    let hash = 0;
-    for (let i = 0; i < str.length; i++) {
-        const char = str.charCodeAt(i);
-        hash = ((hash << 5) - hash) + char;
-        hash = hash & hash; // Convert to 32bit integer
-    }
-    return Math.abs(hash);
-}
-
 interface ParameterStyle {
     bold: boolean;
     italic: boolean;
@@ -54,6 +50,7 @@ export class QuirrelSemanticHighlighter implements vs.Disposable {
     private _decorationTypes: Map<number, vs.TextEditorDecorationType> = new Map();
     private _disposables: vs.Disposable[] = [];
     private _debounceTimer: NodeJS.Timeout | undefined;
+    private _generation: number = 0;  // Bumped per update, older results are dropped
     private _currentPalette: string[] = [];
     private _isDarkTheme: boolean = true;
     private _enabled: boolean = true;
@@ -238,7 +235,7 @@ export class QuirrelSemanticHighlighter implements vs.Disposable {
         }
     }
 
-    private _updateDecorations(editor: vs.TextEditor) {
+    private async _updateDecorations(editor: vs.TextEditor) {
         if (!this._enabled) {
             this._clearDecorations(editor);
             return;
@@ -249,44 +246,79 @@ export class QuirrelSemanticHighlighter implements vs.Disposable {
             return;
         }
 
-        const result = extractSemanticTokens(editor.document.getText());
-        //dbgOutputChannel.appendLine(`Semantic highlighter: got ${result.tokens?.length || 0} tokens`);
+        const generation = ++this._generation;
+        const document = editor.document;
+        const version = document.version;
+        // Later updates of this document cancel passes that did not start yet
+        const options = { key: `semanticTokens:${document.uri.toString()}` };
+        const isCurrent = () =>
+            generation === this._generation && this._enabled && !document.isClosed && document.version === version;
+
+        if (document.lineCount > VIEWPORT_FIRST_MIN_LINES && editor.visibleRanges.length > 0) {
+            // Color what is on screen first, then the whole document
+            const range: LineRange = {
+                startLine: Math.max(0, editor.visibleRanges[0].start.line - VIEWPORT_MARGIN_LINES),
+                endLine: editor.visibleRanges[editor.visibleRanges.length - 1].end.line + VIEWPORT_MARGIN_LINES,
+            };
+            const visible = await documentSemanticTokensBinary(document, range, options);
+            if (!isCurrent()) return;
+            if (visible) this._applyTokens(editor, visible);
+        }
+
+        const result = await documentSemanticTokensBinary(document, undefined, options);
+        if (!isCurrent()) return;
+        if (result) this._applyTokens(editor, result);
+    }
 
+    private _applyTokens(editor: vs.TextEditor, result: PackedSemanticTokens) {
+        const started = isProfilingEnabled() ? performance.now() : 0;
         // Group ranges by identifier name -> color index
-        // We need to get the actual identifier text from the document
         const paletteSize = this._currentPalette.length;
         const rangesByColorIndex: Map<number, vs.Range[]> = new Map();
         const parameterRanges: vs.Range[] = [];
 
-        if (result.tokens) {
-            for (const token of result.tokens) {
-                // Colorize variables/constants, parameters, local functions, enums, and imports
-                if (token.type !== TT_VARIABLE &&
-                    token.type !== TT_PARAMETER &&
-                    token.type !== TT_FUNCTION &&
-                    token.type !== TT_IMPORT &&
-                    token.type !== TT_ENUM) {
-                    continue;
-                }
+        // Color of each distinct identifier, from its hash computed by the engine
+        const nameColors = new Int32Array(result.nameHashes.length);
+        for (let n = 0; n < nameColors.length; ++n)
+            nameColors[n] = Math.abs(result.nameHashes[n]) % paletteSize;
+        const data = result.data;
+        let line = 0;
+        let col = 0;
+
+        for (let i = 0, t = 0; i < data.length; i += 5, ++t) {
+            // Decode delta positions before any filtering
+            const deltaLine = data[i];
+            line += deltaLine;
+            col = deltaLine !== 0 ? data[i + 1] : col + data[i + 1];
+            const length = data[i + 2];
+            const type = data[i + 3];
+
+            // Colorize variables/constants, parameters, local functions, enums, and imports
+            if (type !== TT_VARIABLE &&
+                type !== TT_PARAMETER &&
+                type !== TT_FUNCTION &&
+                type !== TT_IMPORT &&
+                type !== TT_ENUM) {
+                continue;
+            }
 
-                // Convert 1-based line to 0-based
-                const line = Math.max(0, token.line - 1);
-                const range = new vs.Range(line, token.col, line, token.col + token.length);
+            const nameId = result.nameIds[t];
+            if (nameId < 0) {
+                continue;
+            }
 
-                // Get the identifier text to compute its color
-                const identifierText = editor.document.getText(range);
-                const colorIndex = hashString(identifierText) % paletteSize;
+            const range = new vs.Range(line, col, line, col + length);
+            const colorIndex = nameColors[nameId];
 
-                // All tokens get color
-                if (!rangesByColorIndex.has(colorIndex)) {
-                    rangesByColorIndex.set(colorIndex, []);
-                }
-                rangesByColorIndex.get(colorIndex)!.push(range);
+            // All tokens get color
+            if (!rangesByColorIndex.has(colorIndex)) {
+                rangesByColorIndex.set(colorIndex, []);
+            }
+            rangesByColorIndex.get(colorIndex)!.push(range);
 
-                // Parameters additionally get font style
-                if (token.type === TT_PARAMETER) {
-                    parameterRanges.push(range);
-                }
+            // Parameters additionally get font style
+            if (type === TT_PARAMETER) {
+                parameterRanges.push(range);
             }
         }
 
@@ -304,5 +336,9 @@ export class QuirrelSemanticHighlighter implements vs.Disposable {
         if (paramStyleDecor && parameterRanges.length > 0) {
             editor.setDecorations(paramStyleDecor, parameterRanges);
         }
+
+        if (started > 0) {
+            recordTiming('decorations', performance.now() - started);
+        }
     }
 }
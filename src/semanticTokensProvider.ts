@@ -0,0 +1,55 @@
+import * as vs from 'vscode';
+import { documentSemanticTokensDelta, isParserInitialized, SemanticTokensDelta } from './quirrelParser';
+
+// Order of the C++ TokenType and TokenModifier enums (wasm/semantic_tokens.h)
+export const SEMANTIC_TOKENS_LEGEND = new vs.SemanticTokensLegend(
+    ['variable', 'parameter', 'function', 'class', 'enum', 'enumMember', 'property', 'namespace'],
+    ['declaration', 'readonly']);
+
+// Theme-colored token types for the editor. The engine keeps the last token
+// array it returned per document and answers edit requests with the changed
+// span only. The per-name palette is applied by QuirrelSemanticHighlighter
+// on top, from the same token array.
+export class QuirrelSemanticTokensProvider implements vs.DocumentSemanticTokensProvider, vs.Disposable {
+    private _onDidChange = new vs.EventEmitter<void>();
+    readonly onDidChangeSemanticTokens = this._onDidChange.event;
+
+    // Called when the engine becomes ready, earlier requests got no tokens
+    refresh() {
+        this._onDidChange.fire();
+    }
+
+    dispose() {
+        this._onDidChange.dispose();
+    }
+
+    async provideDocumentSemanticTokens(document: vs.TextDocument,
+                                        token: vs.CancellationToken): Promise<vs.SemanticTokens | undefined> {
+        const delta = await this._delta(document, 0, token);
+        return delta ? new vs.SemanticTokens(toUint32(delta.data), `${delta.resultId}`) : undefined;
+    }
+
+    async provideDocumentSemanticTokensEdits(document: vs.TextDocument, previousResultId: string,
+                                             token: vs.CancellationToken): Promise<vs.SemanticTokens | vs.SemanticTokensEdits | undefined> {
+        const delta = await this._delta(document, parseInt(previousResultId, 10) || 0, token);
+        if (!delta)
+            return undefined;
+        if (delta.full)
+            return new vs.SemanticTokens(toUint32(delta.data), `${delta.resultId}`);
+        const edit = new vs.SemanticTokensEdit(delta.start, delta.deleteCount, toUint32(delta.data));
+        return new vs.SemanticTokensEdits([edit], `${delta.resultId}`);
+    }
+
+    private async _delta(document: vs.TextDocument, previousResultId: number,
+                         token: vs.CancellationToken): Promise<SemanticTokensDelta | undefined> {
+        if (!isParserInitialized())
+            return undefined;
+        const delta = await documentSemanticTokensDelta(document, previousResultId, { token });
+        return delta || undefined;
+    }
+}
+
+// Token ints are never negative, reinterpret without copying
+function toUint32(data: Int32Array): Uint32Array {
+    return new Uint32Array(data.buffer, data.byteOffset, data.length);
+}
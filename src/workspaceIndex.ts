@@ -0,0 +1,399 @@
+import * as vs from 'vscode';
+import * as os from 'os';
+import * as path from 'path';
+import { promises as fs, statSync } from 'fs';
+import { EngineClient, engineModulePath } from './engineClient';
+import { FileStamp, IndexCache, hashContent } from './indexCache';
+import { ParseResult, QuirrelSymbol } from './quirrelParser';
+import { dbgOutputChannel } from './utils';
+
+// Files read ahead of the parsers, per worker
+const READ_AHEAD_PER_WORKER = 16;
+// Files parsed by one engine call (processBatch in wasm/batch.h)
+const BATCH_FILES = 16;
+const MAX_AUTO_WORKERS = 8;
+// Batch cache writes after watcher updates
+const CACHE_SAVE_DELAY_MS = 10000;
+
+export interface IndexedModule {
+    uri: vs.Uri;
+    symbols: QuirrelSymbol[];  // Outline of the module, top-level symbols first
+    stamp?: FileStamp;         // File state the outline was parsed from, unset for unsaved editor text and errors
+}
+
+export interface IndexedSymbol {
+    uri: vs.Uri;
+    symbol: QuirrelSymbol;
+    container: string | undefined;
+}
+
+function moduleKey(fsPath: string): string {
+    const normalized = path.normalize(fsPath);
+    return process.platform === 'win32' ? normalized.toLowerCase() : normalized;
+}
+
+// Subsequence match, case-insensitive, as VS Code filters symbol pickers
+function matchesQuery(name: string, query: string): boolean {
+    let pos = 0;
+    const lower = name.toLowerCase();
+    for (let i = 0; i < query.length; ++i) {
+        pos = lower.indexOf(query.charAt(i), pos);
+        if (pos < 0)
+            return false;
+        ++pos;
+    }
+    return true;
+}
+
+interface QueuedParse {
+    source: Buffer;
+    resolve(result: ParseResult): void;
+}
+
+// Records of wasm/batch.h, without analyzer configs
+function packBatch(sources: Buffer[]): Uint8Array {
+    let size = 0;
+    for (const source of sources)
+        size += 8 + source.length;
+    const packed = Buffer.alloc(size);
+    let pos = 0;
+    for (const source of sources) {
+        pos = packed.writeUInt32LE(0, pos);
+        pos = packed.writeUInt32LE(source.length, pos);
+        pos += source.copy(packed, pos);
+    }
+    return packed;
+}
+
+function unpackBatch(data: Uint8Array): string[] {
+    const bytes = Buffer.from(data.buffer, data.byteOffset, data.byteLength);
+    const results: string[] = [];
+    for (let pos = 0; pos + 4 <= bytes.length; ) {
+        const length = bytes.readUInt32LE(pos);
+        pos += 4;
+        results.push(bytes.toString('utf8', pos, pos + length));
+        pos += length;
+    }
+    return results;
+}
+
+// WASM parser workers dedicated to indexing, separate from the one serving
+// open documents so that a workspace crawl never delays editor requests.
+// They never load the native addon, which serves one worker per process.
+class ParserPool {
+    private _clients: EngineClient[] = [];
+    private readonly _wasmJsPath: string;
+    // Files waiting for the next batch
+    private _queue: QueuedParse[] = [];
+    private _flushScheduled: boolean = false;
+
+    constructor(wasmJsPath: string) {
+        this._wasmJsPath = wasmJsPath;
+    }
+
+    get size(): number {
+        return this._clients.length;
+    }
+
+    async resize(size: number) {
+        while (this._clients.length > size) {
+            this._clients.pop()!.terminate();
+        }
+        const started: Promise<void>[] = [];
+        while (this._clients.length < size) {
+            const client = new EngineClient(this._wasmJsPath);
+            client.onExit = () => {
+                const index = this._clients.indexOf(client);
+                if (index >= 0)
+                    this._clients.splice(index, 1);
+            };
+            this._clients.push(client);
+            started.push(client.start());
+        }
+        await Promise.all(started);
+    }
+
+    // Files asked for in the same turn go to the engine together
+    parse(source: string | Buffer): Promise<ParseResult> {
+        return new Promise<ParseResult>(resolve => {
+            this._queue.push({ source: typeof source === 'string' ? Buffer.from(source, 'utf8') : source, resolve });
+            if (!this._flushScheduled) {
+                this._flushScheduled = true;
+                setImmediate(() => this._flush());
+            }
+        });
+    }
+
+    private async _flush() {
+        this._flushScheduled = false;
+        if (this._clients.length === 0)
+            await this.resize(1);
+
+        while (this._queue.length > 0) {
+            // Least busy worker
+            let client = this._clients[0];
+            for (const c of this._clients) {
+                if (c.load < client.load)
+                    client = c;
+            }
+            this._parseBatch(client, this._queue.splice(0, BATCH_FILES));
+        }
+    }
+
+    private async _parseBatch(client: EngineClient, batch: QueuedParse[]) {
+        const reply = await client.call('processBatch', [packBatch(batch.map(q => q.source)), 0]);
+        let error = reply.type === 'error' ? reply.message : 'Request cancelled';
+        if (reply.type === 'result') {
+            const results = reply.result ? unpackBatch(reply.result.data) : [];
+            if (results.length === batch.length) {
+                batch.forEach((q, i) => q.resolve(JSON.parse(results[i]) as ParseResult));
+                return;
+            }
+            error = 'Malformed batch result';
+        }
+        for (const q of batch)
+            q.resolve({ error, symbols: [] });
+    }
+
+    dispose() {
+        this.resize(0);
+    }
+}
+
+// Outline of every .nut file in the workspace, parsed once in the background
+// and kept up to date by a file watcher
+export class WorkspaceIndex implements vs.Disposable {
+    private _modules: Map<string, IndexedModule> = new Map();
+    private _pending: Map<string, Promise<IndexedModule | undefined>> = new Map();
+    private _pool: ParserPool;
+    private _disposables: vs.Disposable[] = [];
+    private _crawl: Promise<void> | undefined;
+
+    // Outlines from the last session, only while the first crawl runs
+    private _cache: IndexCache | undefined;
+    private readonly _cacheFile: string | undefined;
+    private readonly _engineVersion: string;
+    private _cacheDirty: boolean = false;
+    private _saveTimer: NodeJS.Timeout | undefined;
+
+    // storagePath: workspace storage folder for the outline cache, none to disable it
+    constructor(extensionPath: string, storagePath: string | undefined) {
+        const wasmJsPath = engineModulePath(extensionPath);
+        this._pool = new ParserPool(wasmJsPath);
+        this._cacheFile = storagePath ? path.join(storagePath, 'symbol-index.bin') : undefined;
+
+        // Outlines depend on the engine build, a rebuilt module invalidates the cache
+        try {
+            const wasm = statSync(wasmJsPath.replace(/\.js$/, '.wasm'));
+            this._engineVersion = `${wasm.size}:${wasm.mtimeMs}`;
+        } catch (e) {
+            this._engineVersion = 'unknown';
+        }
+
+        const watcher = vs.workspace.createFileSystemWatcher('**/*.nut');
+        this._disposables.push(watcher);
+        this._disposables.push(watcher.onDidCreate(uri => this._reindex(uri)));
+        this._disposables.push(watcher.onDidChange(uri => this._reindex(uri)));
+        this._disposables.push(watcher.onDidDelete(uri => {
+            this._modules.delete(moduleKey(uri.fsPath));
+            this._cacheDirty = true;
+            this._scheduleSave();
+        }));
+    }
+
+    static isEnabled(): boolean {
+        return vs.workspace.getConfiguration('quirrel.workspaceIndex').get<boolean>('enabled', true);
+    }
+
+    // Index the whole workspace, resolves when every file has been parsed
+    start(): Promise<void> {
+        if (!this._crawl) {
+            this._crawl = this._indexWorkspace().catch(err => {
+                dbgOutputChannel.appendLine(`Workspace indexing failed: ${err}`);
+            });
+        }
+        return this._crawl;
+    }
+
+    // Indexed outline of a module, parsing it now if the crawl has not got there
+    async getModule(uri: vs.Uri): Promise<IndexedModule | undefined> {
+        const key = moduleKey(uri.fsPath);
+        const indexed = this._modules.get(key);
+        if (indexed)
+            return indexed;
+        return this._pending.get(key) ?? this._index(uri);
+    }
+
+    // Top-level declaration of name in module
+    async findExport(uri: vs.Uri, name: string): Promise<QuirrelSymbol | undefined> {
+        const module = await this.getModule(uri);
+        return module ? module.symbols.find(sym => sym.name === name) : undefined;
+    }
+
+    search(query: string, limit: number): IndexedSymbol[] {
+        const result: IndexedSymbol[] = [];
+        const lowerQuery = query.toLowerCase();
+
+        const visit = (uri: vs.Uri, symbols: QuirrelSymbol[], container: string | undefined): boolean => {
+            for (const symbol of symbols) {
+                if (matchesQuery(symbol.name, lowerQuery)) {
+                    result.push({ uri, symbol, container });
+                    if (result.length >= limit)
+                        return false;
+                }
+                if (symbol.children && !visit(uri, symbol.children, symbol.name))
+                    return false;
+            }
+            return true;
+        };
+
+        for (const module of this._modules.values()) {
+            if (!visit(module.uri, module.symbols, undefined))
+                break;
+        }
+        return result;
+    }
+
+    dispose() {
+        this._disposables.forEach(d => d.dispose());
+        this._pool.dispose();
+        if (this._saveTimer) {
+            clearTimeout(this._saveTimer);
+            this._saveCache();
+        }
+    }
+
+    private async _indexWorkspace() {
+        const files = await vs.workspace.findFiles('**/*.nut');
+        if (files.length === 0)
+            return;
+
+        if (this._cacheFile) {
+            this._cache = new IndexCache(this._cacheFile, this._engineVersion);
+            await this._cache.load();
+        }
+
+        const configured = vs.workspace.getConfiguration('quirrel.workspaceIndex').get<number>('maxWorkers', 0);
+        const auto = Math.min(MAX_AUTO_WORKERS, Math.max(1, os.cpus().length - 1));
+        const workers = Math.max(1, Math.min(configured > 0 ? configured : auto, files.length));
+        await this._pool.resize(workers);
+
+        const started = Date.now();
+        await vs.window.withProgress({
+            location: vs.ProgressLocation.Window,
+            title: 'Indexing Quirrel files',
+        }, async () => {
+            // Keep every worker busy while the next files are read from disk
+            let next = 0;
+            const lanes: Promise<void>[] = [];
+            for (let i = 0; i < workers * READ_AHEAD_PER_WORKER; ++i) {
+                lanes.push((async () => {
+                    while (next < files.length) {
+                        await this._index(files[next++]);
+                    }
+                })());
+            }
+            await Promise.all(lanes);
+        });
+
+        // Later updates come one file at a time
+        await this._pool.resize(1);
+        const cached = this._cache ? this._cache.size : 0;
+        this._cache = undefined;
+        dbgOutputChannel.appendLine(
+            `Indexed ${this._modules.size} Quirrel files in ${Date.now() - started} ms ` +
+            `using ${workers} workers, ${cached} cached outlines`);
+        await this._saveCache();
+    }
+
+    private _reindex(uri: vs.Uri) {
+        this._modules.delete(moduleKey(uri.fsPath));
+        this._cacheDirty = true;
+        this._index(uri).then(() => this._scheduleSave());
+    }
+
+    private _scheduleSave() {
+        if (!this._saveTimer) {
+            this._saveTimer = setTimeout(() => {
+                this._saveTimer = undefined;
+                this._saveCache();
+            }, CACHE_SAVE_DELAY_MS);
+        }
+    }
+
+    private async _saveCache() {
+        if (!this._cacheFile || !this._cacheDirty)
+            return;
+        this._cacheDirty = false;
+
+        const entries: [string, FileStamp, QuirrelSymbol[]][] = [];
+        for (const [key, module] of this._modules) {
+            if (module.stamp)
+                entries.push([key, module.stamp, module.symbols]);
+        }
+        try {
+            await IndexCache.save(this._cacheFile, this._engineVersion, entries);
+        } catch (e) {
+            dbgOutputChannel.appendLine(`Failed to write symbol index cache: ${e}`);
+        }
+    }
+
+    // Outline of a file on disk, from the cache if the file has not changed
+    private async _loadOutline(key: string, fsPath: string): Promise<IndexedModule | undefined> {
+        const stat = await fs.stat(fsPath);
+        const cached = this._cache ? this._cache.stamp(key) : undefined;
+
+        if (cached && cached.mtimeMs === stat.mtimeMs && cached.size === stat.size) {
+            const symbols = this._cache!.symbols(key);
+            if (symbols)
+                return { uri: vs.Uri.file(fsPath), symbols, stamp: cached };
+        }
+
+        const content = await fs.readFile(fsPath);
+        const stamp = { mtimeMs: stat.mtimeMs, size: stat.size, hash: hashContent(content) };
+        this._cacheDirty = true;
+
+        // Touched but not changed
+        if (cached && cached.hash.equals(stamp.hash)) {
+            const symbols = this._cache!.symbols(key);
+            if (symbols)
+                return { uri: vs.Uri.file(fsPath), symbols, stamp };
+        }
+
+        // Only outlines the engine produced are cached, not failed or cancelled calls
+        const result = await this._pool.parse(content);
+        return { uri: vs.Uri.file(fsPath), symbols: result.symbols, stamp: result.error ? undefined : stamp };
+    }
+
+    private _index(uri: vs.Uri): Promise<IndexedModule | undefined> {
+        const key = moduleKey(uri.fsPath);
+        const pending = this._pending.get(key);
+        if (pending)
+            return pending;
+
+        const task = (async () => {
+            try {
+                // Unsaved editor text wins over the file on disk
+                const open = vs.workspace.textDocuments.find(doc => doc.isDirty && moduleKey(doc.uri.fsPath) === key);
+                let module: IndexedModule | undefined;
+                if (open) {
+                    const result = await this._pool.parse(open.getText());
+                    module = { uri, symbols: result.symbols };
+                } else {
+                    module = await this._loadOutline(key, uri.fsPath);
+                }
+                if (module) {
+                    module.uri = uri;
+                    this._modules.set(key, module);
+                }
+                return module;
+            } catch (e) {
+                return undefined;
+            } finally {
+                this._pending.delete(key);
+            }
+        })();
+        this._pending.set(key, task);
+        return task;
+    }
+}
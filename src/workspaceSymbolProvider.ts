@@ -0,0 +1,26 @@
+import * as vs from 'vscode';
+import { WorkspaceIndex } from './workspaceIndex';
+import { symbolKind, symbolRange } from './documentSymbolProvider';
+
+const MAX_RESULTS = 500;
+
+export class QuirrelWorkspaceSymbolProvider implements vs.WorkspaceSymbolProvider {
+    private readonly _index: WorkspaceIndex;
+
+    constructor(index: WorkspaceIndex) {
+        this._index = index;
+    }
+
+    provideWorkspaceSymbols(
+        query: string,
+        _token: vs.CancellationToken
+    ): vs.ProviderResult<vs.SymbolInformation[]> {
+        return this._index.search(query, MAX_RESULTS).map(({ uri, symbol, container }) =>
+            new vs.SymbolInformation(
+                symbol.name,
+                symbolKind(symbol),
+                container ?? '',
+                new vs.Location(uri, symbolRange(symbol))
+            ));
+    }
+}
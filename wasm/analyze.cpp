@@ -4,63 +4,128 @@
 #include <sstream>
 #include <string>
 #include "utils.h"
+#include "document.h"
+#include "resolver.h"
+#include "semantic_tokens.h"
+#include "declaration_map.h"
+#include "extract_symbols.h"
+#include "analyzer_config.h"
+#include "profile.h"
+#include "batch.h"
+#include "cancel.h"
+#include "unit_analysis.h"
 
 
 using namespace SQCompilation;
 
 
-// Diagnostic collector for analyzeCode
-static std::ostringstream* diagOutput = nullptr;
-static bool diagFirst = true;
+// Parse diagnostics are collected by the session when it parses,
+// static analysis messages are added here on top of them.
+// Texts analyzed before are answered from the session without parsing,
+// otherwise only the statements that changed are reanalyzed (unit_analysis.h).
+// configChain: analyzer configs that apply to the document, see analyzer_config.h
+const DiagnosticBuffer& collectMessages(DocumentSession& doc, const std::string& configChain) {
+    uint64_t configKey = analyzerConfigKey(configChain);
+    if (const DiagnosticBuffer* cached = doc.findAnalysis(configKey)) {
+        return *cached;
+    }
+
+    // The analyzer can't be interrupted, don't start it for a cancelled call
+    static const DiagnosticBuffer cancelled;
+    if (callCancelled()) return cancelled;
 
-static void diagnosticHandler(HSQUIRRELVM /*v*/, const SQCompilerMessage* msg) {
-    if (!diagOutput) return;
+    SqASTData* astData = doc.ast();
+    DiagnosticBuffer messages;
+    messages.append(doc.parseMessages);
 
-    if (!diagFirst) *diagOutput << ",";
-    diagFirst = false;
+    if (astData && callCancelled()) return cancelled;
+    if (astData && !analyzeUnits(doc, astData, configChain, configKey, messages)) return cancelled;
 
-    *diagOutput << "{"
-        << "\"line\":" << msg->line
-        << ",\"col\":" << msg->column
-        << ",\"len\":" << msg->columnsWidth
-        << ",\"file\":\"" << escapeJson(msg->fileName) << "\""
-        << ",\"intId\":" << msg->intId
-        << ",\"textId\":\"" << escapeJson(msg->textId) << "\""
-        << ",\"message\":\"" << escapeJson(msg->message) << "\""
-        << ",\"isError\":" << (msg->isError ? "true" : "false")
-        << "}";
+    return doc.storeAnalysis(configKey, std::move(messages));
 }
 
-std::string analyzeCode(const std::string& source) {
-    HSQUIRRELVM vm = sq_open(256);
-    if (!vm) {
+std::string analyzeSession(DocumentSession& doc, const std::string& configChain) {
+    if (!doc.vm) {
         return "{\"messages\":[]}";
     }
-
-    // Set up diagnostic collection
     std::ostringstream out;
-    diagOutput = &out;
-    diagFirst = true;
     out << "{\"messages\":[";
+    collectMessages(doc, configChain).writeJson(out);
+    out << "]}";
+    return out.str();
+}
 
-    sq_resetanalyzerconfig();
-    // TODO: Also search for local configs
-
-    // All diagnostics (parse errors + static analysis) come through this callback
-    sq_setcompilerdiaghandler(vm, diagnosticHandler);
+std::string analyzeCode(const std::string& source) {
+    DocumentSession doc(source);
+    return analyzeSession(doc, std::string());
+}
 
-    SqASTData* astData = sq_parsetoast(vm, source.c_str(), source.length(),
-                                        "document", SQFalse, SQFalse);
+std::string documentAnalyze(int docId, const std::string& configChain) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc) {
+        return "{\"messages\":[]}";
+    }
+    return analyzeSession(*doc, configChain);
+}
 
-    if (astData && astData->root) {
-        sq_analyzeast(vm, astData, nullptr, source.c_str(), source.length());
-        sq_releaseASTData(vm, astData);
+// Outline symbols, semantic tokens, declaration map and diagnostics from one parse.
+// Tokens and declarations share a single resolver walk, the outline walk only
+// visits declaration statements and function bodies.
+std::string documentAnalyzeAll(int docId, const std::string& configChain) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc || !doc->vm) {
+        return "{\"error\":\"Unknown document\",\"symbols\":[],\"tokens\":[],\"declarations\":[],\"messages\":[]}";
     }
 
-    out << "]}";
+    SqASTData* astData = doc->ast();
 
-    diagOutput = nullptr;
-    sq_close(vm);
+    std::ostringstream out;
+    if (astData) {
+        // Fill the session's declaration index in the same walk if it is not built yet
+        std::unique_ptr<DeclarationMap> declarations;
+        SemanticTokenExtractor tokens(doc->source, doc->lines(), doc->identifiers());
+        ScopeResolver resolver;
+        resolver.addListener(&tokens);
+        if (!doc->declarations) {
+            declarations.reset(new DeclarationMap());
+            resolver.addListener(declarations.get());
+        }
+        {
+            ProfileScope profile(PROFILE_WALK);
+            astData->root->visit(&resolver);
+        }
+
+        if (resolver.isCancelled()) {
+            return "{\"error\":\"Cancelled\",\"symbols\":[],\"tokens\":[],\"declarations\":[],\"messages\":[]}";
+        }
+        if (declarations) {
+            declarations->sort();
+            doc->declarations = std::move(declarations);
+        }
+
+        out << "{\"error\":null,\"symbols\":[";
+        writeSymbols(out, astData->root);
+        out << "],\"tokens\":[";
+        tokens.writeJson(out);
+        out << "],\"declarations\":[";
+        doc->declarations->writeJson(out);
+        out << "]";
+    } else {
+        out << "{\"error\":\"" << escapeJson(doc->parseError.c_str()) << "\""
+            << ",\"symbols\":[],\"tokens\":[],\"declarations\":[]";
+    }
 
+    // Analyzer runs last, on the same AST
+    out << ",\"messages\":[";
+    collectMessages(*doc, configChain).writeJson(out);
+    out << "]}";
     return out.str();
 }
+
+// Messages of the document's current text, stored in the session until it
+// is analyzed again. nullptr for an unknown document.
+const DiagnosticBuffer* documentAnalyzePacked(int docId, const std::string& configChain) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc || !doc->vm) return nullptr;
+    return &collectMessages(*doc, configChain);
+}
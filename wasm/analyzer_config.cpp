@@ -0,0 +1,117 @@
+#include "analyzer_config.h"
+#include "squirrel.h"
+#include <stdio.h>
+#include <unordered_map>
+#include "utils.h"
+
+#if defined(__EMSCRIPTEN__)
+#elif defined(_WIN32)
+#include <process.h>
+#include <filesystem>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <filesystem>
+#endif
+
+
+struct RegisteredConfig {
+    std::string file;   // Copy in the in-memory filesystem
+    uint64_t revision;  // Bumped by every setAnalyzerConfig
+};
+
+static std::unordered_map<std::string, RegisteredConfig> configs;
+static uint64_t nextRevision = 1;
+static int nextFileId = 1;
+
+// Settings the analyzer currently has, defaults until the first apply
+static std::string appliedChain;
+static uint64_t appliedKey = 0;
+static bool appliedValid = false;
+
+
+// In-memory filesystem under WASM. Native builds share the real temp
+// directory with other processes, so names include the process id.
+static std::string configFileName(int id) {
+#ifdef __EMSCRIPTEN__
+    return "/tmp/analyzer-" + std::to_string(id) + ".sqconfig";
+#else
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+    std::string name = "quirrel-analyzer-" + std::to_string(getpid()) + "-" + std::to_string(id) + ".sqconfig";
+    return ec ? name : (dir / name).string();
+#endif
+}
+
+template<typename F>
+static void forEachPath(const std::string& chain, F f) {
+    size_t start = 0;
+    while (start < chain.size()) {
+        size_t end = chain.find('\n', start);
+        if (end == std::string::npos) end = chain.size();
+        if (end > start) f(chain.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+bool setAnalyzerConfig(const std::string& path, const std::string& text) {
+    auto it = configs.find(path);
+    std::string file = it != configs.end()
+        ? it->second.file
+        : configFileName(nextFileId++);
+
+    FILE* f = fopen(file.c_str(), "wb");
+    if (!f) return false;
+    bool written = fwrite(text.data(), 1, text.size(), f) == text.size();
+    written = fclose(f) == 0 && written;
+    if (!written) {
+        remove(file.c_str());
+        if (it != configs.end()) configs.erase(it);
+        return false;
+    }
+
+    configs[path] = {file, nextRevision++};
+    return true;
+}
+
+void removeAnalyzerConfig(const std::string& path) {
+    auto it = configs.find(path);
+    if (it == configs.end()) return;
+    remove(it->second.file.c_str());
+    configs.erase(it);
+}
+
+void clearAnalyzerConfigs() {
+    for (const auto& entry : configs) {
+        remove(entry.second.file.c_str());
+    }
+    configs.clear();
+    appliedValid = false;
+}
+
+uint64_t analyzerConfigKey(const std::string& chain) {
+    uint64_t key = hashBytes(chain.data(), chain.size());
+    forEachPath(chain, [&](const std::string& path) {
+        auto it = configs.find(path);
+        uint64_t revision = it != configs.end() ? it->second.revision : 0;
+        key ^= revision + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+    });
+    return key;
+}
+
+void applyAnalyzerConfig(const std::string& chain) {
+    uint64_t key = analyzerConfigKey(chain);
+    if (appliedValid && appliedKey == key && appliedChain == chain) return;
+
+    sq_resetanalyzerconfig();
+    forEachPath(chain, [](const std::string& path) {
+        auto it = configs.find(path);
+        if (it != configs.end()) {
+            sq_loadanalyzerconfig(it->second.file.c_str());
+        }
+    });
+
+    appliedChain = chain;
+    appliedKey = key;
+    appliedValid = true;
+}
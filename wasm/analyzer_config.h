@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+
+// Analyzer configs (.sqconfig) registered by the extension, keyed by their
+// path on the extension side. Each text is written once to the in-memory
+// filesystem, where sq_loadanalyzerconfig reads it from.
+bool setAnalyzerConfig(const std::string& path, const std::string& text);
+void removeAnalyzerConfig(const std::string& path);
+void clearAnalyzerConfigs();
+
+// A config chain is a newline-separated list of registered paths, outermost
+// directory first, so that nested configs override their parents.
+
+// Make the analyzer settings match a chain. Only resets and reloads when the
+// chain or one of its configs changed since the settings were last applied.
+void applyAnalyzerConfig(const std::string& chain);
+
+// Identifies the settings a chain stands for, changes with any of its configs
+uint64_t analyzerConfigKey(const std::string& chain);
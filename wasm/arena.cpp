@@ -0,0 +1,48 @@
+#include "arena.h"
+
+
+Arena::Arena(size_t blockSize) : current(0), used(0), blockSize(blockSize) {}
+
+void* Arena::allocate(size_t size, size_t align) {
+    if (!blocks.empty()) {
+        size_t offset = (used + align - 1) & ~(align - 1);
+        if (offset + size <= blocks[current].size) {
+            used = offset + size;
+            return blocks[current].data.get() + offset;
+        }
+        ++current;
+    }
+
+    // Reuse the next retained block if it is big enough, otherwise insert
+    // a fresh one in front of it. Block storage from new[] is aligned for
+    // any fundamental type, so offset 0 needs no adjustment.
+    if (current == blocks.size() || blocks[current].size < size) {
+        size_t bytes = size > blockSize ? size : blockSize;
+        blocks.insert(blocks.begin() + current, Block{std::unique_ptr<char[]>(new char[bytes]), bytes});
+    }
+
+    used = size;
+    return blocks[current].data.get();
+}
+
+void Arena::rewind(const Mark& m) {
+    current = m.block;
+    used = m.used;
+}
+
+void Arena::shrink() {
+    if (current + 1 < blocks.size()) {
+        blocks.erase(blocks.begin() + current + 1, blocks.end());
+    }
+}
+
+size_t Arena::reserved() const {
+    size_t bytes = 0;
+    for (const Block& block : blocks) bytes += block.size;
+    return bytes;
+}
+
+Arena& scratchArena() {
+    static thread_local Arena arena;
+    return arena;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Bump allocator for short-lived, trivially destructible objects.
+// Everything allocated after a mark is released at once by rewinding to it;
+// blocks are kept for reuse, so repeated passes stop calling malloc once
+// the arena has grown to their working size.
+class Arena {
+public:
+    struct Mark {
+        size_t block;
+        size_t used;
+    };
+
+    explicit Arena(size_t blockSize = 64 * 1024);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align);
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+    }
+
+    // Uninitialized storage for n objects
+    template<typename T>
+    T* makeArray(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+        return static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+    }
+
+    Mark mark() const { return {current, used}; }
+    void rewind(const Mark& m);
+
+    // Free the blocks kept for reuse past the one being filled
+    void shrink();
+    // Bytes of all blocks, in use or kept
+    size_t reserved() const;
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current;  // Block being filled
+    size_t used;     // Bytes taken in the current block
+    size_t blockSize;
+};
+
+
+// Per-thread arena for structures that live for one analysis call
+Arena& scratchArena();
@@ -0,0 +1,50 @@
+#include "batch.h"
+#include <stdint.h>
+
+
+static bool readU32(const std::string& input, size_t& pos, uint32_t& value) {
+    if (input.size() - pos < 4) return false;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(input.data() + pos);
+    value = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    pos += 4;
+    return true;
+}
+
+static bool readField(const std::string& input, size_t& pos, std::string& field) {
+    uint32_t length;
+    if (!readU32(input, pos, length) || input.size() - pos < length) return false;
+    field.assign(input, pos, length);
+    pos += length;
+    return true;
+}
+
+static void appendU32(std::string& out, uint32_t value) {
+    char bytes[4] = { char(value), char(value >> 8), char(value >> 16), char(value >> 24) };
+    out.append(bytes, 4);
+}
+
+
+static std::string batchResult;
+
+// Each record gets its own session, whose VM comes from the session pool
+// (see document.cpp); walks reuse the scratch arena
+const std::string* processBatch(const std::string& input, int operation) {
+    if (operation != BATCH_SYMBOLS && operation != BATCH_ANALYZE) return nullptr;
+
+    batchResult.clear();
+    std::string configChain, source;
+    for (size_t pos = 0; pos < input.size(); ) {
+        if (!readField(input, pos, configChain) || !readField(input, pos, source)) {
+            batchResult.clear();
+            return nullptr;
+        }
+
+        DocumentSession doc(source);
+        std::string result = operation == BATCH_SYMBOLS
+            ? extractSymbols(doc)
+            : analyzeSession(doc, configChain);
+        appendU32(batchResult, uint32_t(result.size()));
+        batchResult += result;
+    }
+    return &batchResult;
+}
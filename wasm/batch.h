@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include "document.h"
+
+
+// Operations of processBatch
+enum BatchOperation {
+    BATCH_SYMBOLS = 0,  // parseAndExtractSymbols results
+    BATCH_ANALYZE = 1,  // analyzeCode results, under each record's analyzer configs
+};
+
+// Runs one operation over many documents packed into one buffer, so that
+// indexing and linting cross into the engine once per batch, not per file.
+// Input records, integers are little-endian:
+//   u32 configChainLength, configChain (see analyzer_config.h, may be empty),
+//   u32 sourceLength, source
+// The result holds, in record order, u32 length and the JSON result of each
+// document. It is kept until the next batch; nullptr if the input is malformed.
+const std::string* processBatch(const std::string& input, int operation);
+
+// Session queries with the JSON of the single-document entry points
+std::string extractSymbols(DocumentSession& doc);
+std::string analyzeSession(DocumentSession& doc, const std::string& configChain);
+// Parse and analyzer messages, kept in the session's analysis cache
+const DiagnosticBuffer& collectMessages(DocumentSession& doc, const std::string& configChain);
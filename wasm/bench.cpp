@@ -0,0 +1,173 @@
+// Native benchmark of the engine entry points over a corpus of Quirrel files.
+//
+//   cmake -S wasm -B wasm/build-tools -DQUIRREL_NAPI=OFF && cmake --build wasm/build-tools --target quirrel-bench
+//   wasm/build-tools/quirrel-bench [-n iterations] <file or directory>...
+//
+// Directories are searched for .nut files. scripts/bench-wasm.mjs runs the
+// same phases on the WASM build and can write its synthetic corpus to disk
+// (--write-corpus) to feed this one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "engine.h"
+#include "identifier_index.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+
+// Declaration lookups per run, at identifiers spread over the file
+static const int DECLARATION_SAMPLES = 16;
+
+
+struct CorpusFile {
+    std::string path;
+    std::string source;
+    int lineCount;
+    std::vector<std::pair<int, int>> samplePositions;  // 1-based line, 0-based column
+};
+
+struct PhaseStats {
+    const char* name;
+    std::vector<double> ms;  // One entry per run
+    double totalMs = 0;
+    size_t totalBytes = 0;
+};
+
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, size_t(p * double(values.size() - 1) + 0.5));
+    return values[index];
+}
+
+static bool loadFile(const std::string& path, CorpusFile& file) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream text;
+    text << in.rdbuf();
+
+    file.path = path;
+    file.source = text.str();
+    file.lineCount = 1 + int(std::count(file.source.begin(), file.source.end(), '\n'));
+
+    // Positions of identifiers evenly spread over the file
+    IdentifierIndex identifiers;
+    identifiers.build(file.source);
+    const auto& tokens = identifiers.tokens();
+    int samples = std::min<int>(DECLARATION_SAMPLES, int(tokens.size()));
+    for (int i = 0; i < samples; ++i) {
+        uint32_t offset = tokens[size_t(i) * tokens.size() / samples].offset;
+        size_t newline = offset == 0 ? std::string::npos : file.source.rfind('\n', offset - 1);
+        size_t lineStart = newline == std::string::npos ? 0 : newline + 1;
+        int line = 1 + int(std::count(file.source.begin(), file.source.begin() + offset, '\n'));
+        file.samplePositions.push_back({line, int(offset - lineStart)});
+    }
+    return true;
+}
+
+static void collectFiles(const std::string& path, std::vector<CorpusFile>& files) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        std::vector<std::string> found;
+        for (const auto& entry : fs::recursive_directory_iterator(path, ec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".nut")
+                found.push_back(entry.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        for (const auto& f : found) collectFiles(f, files);
+        return;
+    }
+
+    CorpusFile file;
+    if (loadFile(path, file))
+        files.push_back(std::move(file));
+    else
+        fprintf(stderr, "Cannot read %s\n", path.c_str());
+}
+
+template<typename F>
+static double timeMs(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void printRow(const char* label, const std::vector<double>& ms, size_t bytesPerRun) {
+    double p50 = percentile(ms, 0.5);
+    printf("  %-12s p50 %9.3f  p90 %9.3f  p99 %9.3f  max %9.3f ms  %8.2f MB/s\n",
+        label, p50, percentile(ms, 0.9), percentile(ms, 0.99), percentile(ms, 1.0),
+        p50 > 0 ? double(bytesPerRun) / (1024.0 * 1024.0) / (p50 / 1000.0) : 0.0);
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+    std::vector<CorpusFile> files;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = std::max(1, atoi(argv[++i]));
+        } else {
+            collectFiles(argv[i], files);
+        }
+    }
+    if (files.empty()) {
+        fprintf(stderr, "Usage: quirrel-bench [-n iterations] <file or directory>...\n");
+        return 1;
+    }
+
+    PhaseStats totals[] = { {"symbols"}, {"analyze"}, {"tokens"}, {"declaration"} };
+
+    for (const CorpusFile& file : files) {
+        printf("%s: %d lines, %.1f KB\n", file.path.c_str(), file.lineCount, double(file.source.size()) / 1024.0);
+
+        PhaseStats phases[] = { {"symbols"}, {"analyze"}, {"tokens"}, {"declaration"} };
+        volatile size_t sink = 0;  // Keeps results observable
+        for (int run = 0; run < iterations; ++run) {
+            phases[0].ms.push_back(timeMs([&] { sink += parseAndExtractSymbols(file.source).size(); }));
+            phases[1].ms.push_back(timeMs([&] { sink += analyzeCode(file.source).size(); }));
+            phases[2].ms.push_back(timeMs([&] { sink += extractSemanticTokens(file.source).size(); }));
+            for (const auto& pos : file.samplePositions) {
+                phases[3].ms.push_back(timeMs([&] { sink += findDeclarationAt(file.source, pos.first, pos.second).size(); }));
+            }
+        }
+
+        for (int p = 0; p < 4; ++p) {
+            if (phases[p].ms.empty()) continue;
+            printRow(phases[p].name, phases[p].ms, file.source.size());
+            for (double ms : phases[p].ms) totals[p].totalMs += ms;
+            totals[p].totalBytes += file.source.size() * phases[p].ms.size();
+        }
+    }
+
+    printf("Throughput over %zu files, %d runs each:\n", files.size(), iterations);
+    for (const PhaseStats& total : totals) {
+        if (total.totalMs <= 0) continue;
+        printf("  %-12s %8.2f MB/s\n", total.name,
+            double(total.totalBytes) / (1024.0 * 1024.0) / (total.totalMs / 1000.0));
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        long peakKb = usage.ru_maxrss / 1024;
+#else
+        long peakKb = usage.ru_maxrss;
+#endif
+        printf("Peak RSS: %.1f MB\n", double(peakKb) / 1024.0);
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "cancel.h"
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+
+// The flags live in a SharedArrayBuffer outside the WASM heap
+EM_JS(int, hostCallCancelled, (), {
+    var flags = Module['cancelFlags'];
+    if (!flags || flags.length < 2) return 0;
+    var id = Atomics.load(flags, 0);
+    return id !== 0 && Atomics.load(flags, 1 + id % (flags.length - 1)) === id ? 1 : 0;
+});
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// Written by the extension host thread with Atomics.store
+static const int32_t* cancelFlags = nullptr;
+static size_t cancelFlagCount = 0;
+
+static int32_t loadFlag(size_t i) {
+#if defined(_MSC_VER) && defined(_M_ARM64)
+    return int32_t(__ldar32(reinterpret_cast<unsigned __int32 volatile*>(const_cast<int32_t*>(&cancelFlags[i]))));
+#elif defined(_MSC_VER)
+    // No plain acquire load intrinsic on x86/x64; an interlocked no-op is a full barrier
+    return _InterlockedOr(reinterpret_cast<long volatile*>(const_cast<int32_t*>(&cancelFlags[i])), 0);
+#else
+    return __atomic_load_n(&cancelFlags[i], __ATOMIC_ACQUIRE);
+#endif
+}
+
+void setCancelFlags(const int32_t* flags, size_t count) {
+    cancelFlags = count >= 2 ? flags : nullptr;
+    cancelFlagCount = count >= 2 ? count : 0;
+}
+
+static bool flagCancelled() {
+#ifdef __EMSCRIPTEN__
+    return hostCallCancelled() != 0;
+#else
+    if (!cancelFlags) return false;
+    int32_t id = loadFlag(0);
+    return id > 0 && loadFlag(1 + size_t(id) % (cancelFlagCount - 1)) == id;
+#endif
+}
+
+// Some walk saw the flag since the last takeCallCancelled()
+static bool stoppedEarly = false;
+
+bool callCancelled() {
+    if (!flagCancelled()) return false;
+    stoppedEarly = true;
+    return true;
+}
+
+bool takeCallCancelled() {
+    bool stopped = stoppedEarly;
+    stoppedEarly = false;
+    return stopped;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Cooperative cancellation of the engine call in progress. The host shares
+// an Int32Array with the engine: [0] is the id of the running call, set by
+// the worker around each call, and slot 1 + id % (length - 1) is set to the
+// id once the host gives up on that call. Walks poll it and stop early.
+// What they leave behind is incomplete, so it is not cached, and the worker
+// answers the call as cancelled if it stopped early. Without flags no call
+// is ever cancelled.
+
+// Native builds read the flags from memory shared with JS (napi.cpp); the
+// WASM build reads Module.cancelFlags through a JS import instead.
+void setCancelFlags(const int32_t* flags, size_t count);
+
+// The host gave up on the running call
+bool callCancelled();
+
+// Whether callCancelled() returned true since the last take, that is whether
+// the call that just returned stopped early. A call that saw no flag finished
+// and its result holds even if the host gave up on it meanwhile.
+bool takeCallCancelled();
+
+// callCancelled() once every interval checks, for polling per AST node
+class CancelPoll {
+public:
+    explicit CancelPoll(int interval_ = 1024) : interval(interval_), countdown(interval_) {}
+
+    bool operator()() {
+        if (--countdown > 0) return false;
+        countdown = interval;
+        return callCancelled();
+    }
+
+private:
+    int interval;
+    int countdown;
+};
@@ -0,0 +1,223 @@
+#include "declaration_map.h"
+#include <algorithm>
+#include <functional>
+#include <string.h>
+#include "utils.h"
+#include "profile.h"
+
+
+using namespace SQCompilation;
+
+
+// Original name of a selectively imported local name, nullptr for module aliases
+static const char* importedNameOf(ImportStmt* import, const char* localName) {
+    for (const SQModuleImportSlot& slot : import->slots) {
+        const char* local = slot.alias ? slot.alias : slot.name;
+        if (strcmp(local, localName) == 0) return slot.name;
+    }
+    return nullptr;
+}
+
+void DeclarationMap::onDeclaration(const ResolvedSymbol& sym, const NameSite& site) {
+    if (sym.node) decls.push_back({sym.node, sym.name, sym.kind, sym.module, site, 0, 0});
+}
+
+void DeclarationMap::onReference(Id* id, const ResolvedSymbol& sym) {
+    const char* importedName = nullptr;
+    if (sym.node && sym.node->op() == TO_IMPORT) {
+        importedName = importedNameOf(static_cast<ImportStmt*>(sym.node), sym.name);
+    }
+    refs.push_back({id->lineStart(), id->columnStart(), id->lineEnd(), id->columnEnd(),
+                    sym.node, sym.name, sym.kind, importedName, sym.module});
+}
+
+static bool startsBefore(const DeclarationMap::Entry& e, int line, int col) {
+    return e.line < line || (e.line == line && e.col <= col);
+}
+
+void DeclarationMap::sort() {
+    ProfileScope profile(PROFILE_SORT);
+    std::sort(refs.begin(), refs.end(), [](const Entry& a, const Entry& b) {
+        if (a.line != b.line) return a.line < b.line;
+        return a.col < b.col;
+    });
+}
+
+const DeclarationMap::Entry* DeclarationMap::find(int line, int col) const {
+    // Identifiers don't overlap: the candidate is the last one starting at or before the cursor
+    auto it = std::partition_point(refs.begin(), refs.end(),
+        [line, col](const Entry& e) { return startsBefore(e, line, col); });
+    if (it == refs.begin()) return nullptr;
+    --it;
+
+    // Cursor at the end of the word still counts
+    if (line > it->endLine || (line == it->endLine && col > it->endCol)) return nullptr;
+    return &*it;
+}
+
+void DeclarationMap::writeJson(std::ostringstream& out) const {
+    ProfileScope profile(PROFILE_SERIALIZE);
+    bool first = true;
+    for (const Entry& e : refs) {
+        if (!first) out << ",";
+        first = false;
+        out << "{\"line\":" << e.line
+            << ",\"col\":" << e.col
+            << ",\"endLine\":" << e.endLine
+            << ",\"endCol\":" << e.endCol
+            << ",\"decl\":";
+        writeDeclaration(out, e);
+        out << "}";
+    }
+}
+
+void DeclarationMap::writeDeclaration(std::ostringstream& out, const Entry& e) {
+    out << "{\"line\":" << e.decl->lineStart()
+        << ",\"col\":" << e.decl->columnStart()
+        << ",\"endLine\":" << e.decl->lineEnd()
+        << ",\"endCol\":" << e.decl->columnEnd()
+        << ",\"kind\":\"" << e.kind << "\"";
+    if (e.decl->op() == TO_IMPORT) {
+        ImportStmt* import = static_cast<ImportStmt*>(e.decl);
+        out << ",\"module\":\"" << escapeJson(import->moduleName) << "\"";
+        if (e.importedName) {
+            out << ",\"name\":\"" << escapeJson(e.importedName) << "\"";
+        }
+    } else if (e.module) {
+        out << ",\"module\":\"" << escapeJson(e.module) << "\""
+            << ",\"name\":\"" << escapeJson(e.name) << "\"";
+    }
+    out << "}";
+}
+
+
+// Symbols order by declaration node, then name, both compared by address
+template<typename A, typename B>
+static bool symbolBefore(const A& a, const B& b) {
+    if (a.decl != b.decl) return std::less<Node*>()(a.decl, b.decl);
+    return std::less<const char*>()(a.name, b.name);
+}
+
+void DeclarationMap::indexUses(const std::string& source, const std::vector<size_t>& lineOffsets,
+                               const IdentifierIndex& identifiers) {
+    ProfileScope profile(PROFILE_SORT);
+
+    uses.resize(refs.size());
+    for (size_t i = 0; i < refs.size(); ++i) uses[i] = (uint32_t)i;
+    // Stable, so every symbol's uses stay in position order
+    std::stable_sort(uses.begin(), uses.end(), [this](uint32_t a, uint32_t b) {
+        return symbolBefore(refs[a], refs[b]);
+    });
+
+    std::stable_sort(decls.begin(), decls.end(), [](const Declaration& a, const Declaration& b) {
+        return symbolBefore(a, b);
+    });
+
+    declsByPosition.clear();
+    for (size_t i = 0; i < decls.size(); ++i) {
+        Declaration& d = decls[i];
+        if (!locateName(source, lineOffsets, identifiers, d.site, d.name, strlen(d.name), d.line, d.col)) {
+            d.line = 0;
+            continue;
+        }
+        declsByPosition.push_back((uint32_t)i);
+    }
+    std::sort(declsByPosition.begin(), declsByPosition.end(), [this](uint32_t a, uint32_t b) {
+        const Declaration& x = decls[a];
+        const Declaration& y = decls[b];
+        return x.line < y.line || (x.line == y.line && x.col < y.col);
+    });
+
+    usesIndexed = true;
+}
+
+size_t DeclarationMap::memoryUsage() const {
+    return sizeof(*this) + refs.capacity() * sizeof(Entry) + decls.capacity() * sizeof(Declaration)
+        + (uses.capacity() + declsByPosition.capacity()) * sizeof(uint32_t);
+}
+
+const DeclarationMap::Declaration* DeclarationMap::findDeclarationName(int line, int col) const {
+    auto it = std::partition_point(declsByPosition.begin(), declsByPosition.end(), [&](uint32_t i) {
+        const Declaration& d = decls[i];
+        return d.line < line || (d.line == line && d.col <= col);
+    });
+    if (it == declsByPosition.begin()) return nullptr;
+    const Declaration& d = decls[*(it - 1)];
+
+    // Cursor at the end of the name still counts
+    if (d.line != line || col > d.col + (int)strlen(d.name)) return nullptr;
+    return &d;
+}
+
+const DeclarationMap::Declaration* DeclarationMap::declarationOf(Node* decl, const char* name) const {
+    Declaration key = {decl, name, nullptr, nullptr, {NameSite::AT, 0, 0}, 0, 0};
+    auto range = std::equal_range(decls.begin(), decls.end(), key, [](const Declaration& a, const Declaration& b) {
+        return symbolBefore(a, b);
+    });
+    // A name declared twice by one node (hoisting) is located by either
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->line > 0) return &*it;
+    }
+    return nullptr;
+}
+
+static void writeRange(std::ostringstream& out, int line, int col, int endLine, int endCol) {
+    out << "{\"line\":" << line
+        << ",\"col\":" << col
+        << ",\"endLine\":" << endLine
+        << ",\"endCol\":" << endCol
+        << "}";
+}
+
+void DeclarationMap::writeReferences(std::ostringstream& out, int line, int col) const {
+    ProfileScope profile(PROFILE_SERIALIZE);
+    Entry target = {};
+    if (const Entry* ref = find(line, col)) {
+        target = *ref;
+    } else if (const Declaration* d = findDeclarationName(line, col)) {
+        target.decl = d->decl;
+        target.name = d->name;
+        target.kind = d->kind;
+    }
+    if (!target.decl) {
+        out << "{\"found\":false}";
+        return;
+    }
+
+    const Declaration* declaration = declarationOf(target.decl, target.name);
+    // Renaming `from "m" import name` or `let { name } = require("m")` would
+    // change which export it takes
+    const char* importedName = target.decl->op() == TO_IMPORT
+        ? importedNameOf(static_cast<ImportStmt*>(target.decl), target.name)
+        : nullptr;
+    bool renamable = declaration && !declaration->module &&
+                     !(importedName && strcmp(importedName, target.name) == 0);
+    int nameLen = (int)strlen(target.name);
+
+    out << "{\"found\":true"
+        << ",\"name\":\"" << escapeJson(target.name) << "\""
+        << ",\"kind\":\"" << target.kind << "\""
+        << ",\"renamable\":" << (renamable ? "true" : "false");
+    if (declaration) {
+        out << ",\"declaration\":";
+        writeRange(out, declaration->line, declaration->col, declaration->line, declaration->col + nameLen);
+    }
+    out << ",\"references\":[";
+
+    auto first = std::lower_bound(uses.begin(), uses.end(), target, [this](uint32_t i, const Entry& key) {
+        return symbolBefore(refs[i], key);
+    });
+    auto last = std::upper_bound(first, uses.end(), target, [this](const Entry& key, uint32_t i) {
+        return symbolBefore(key, refs[i]);
+    });
+    bool firstRef = true;
+    for (auto it = first; it != last; ++it) {
+        const Entry& e = refs[*it];
+        // The resolver may report a declaration's own name as a use
+        if (declaration && e.line == declaration->line && e.col == declaration->col) continue;
+        if (!firstRef) out << ",";
+        firstRef = false;
+        writeRange(out, e.line, e.col, e.endLine, e.endCol);
+    }
+    out << "]}";
+}
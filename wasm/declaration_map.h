@@ -0,0 +1,82 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "resolver.h"
+
+
+// Position-indexed map of every resolved identifier to its declaration,
+// collected in a single ScopeResolver walk. The same edges, inverted, answer
+// reference and rename queries; that index is built on the first such query.
+class DeclarationMap : public ResolveListener {
+public:
+    struct Entry {
+        int line, col;        // Identifier start (1-based line, 0-based column)
+        int endLine, endCol;  // Identifier end
+        SQCompilation::Node* decl;
+        const char* name;     // Interned, a symbol is its decl and name
+        const char* kind;
+        const char* importedName;  // Name in the source module for selective imports
+        const char* module;        // Bindings destructured from require("module")
+    };
+
+    void onDeclaration(const ResolvedSymbol& sym, const NameSite& site) override;
+    void onReference(SQCompilation::Id* id, const ResolvedSymbol& sym) override;
+
+    // Entries in traversal order until sorted
+    const std::vector<Entry>& entries() const { return refs; }
+
+    // Order entries by position so that lookups can binary search
+    void sort();
+
+    // Declaration of the identifier under (or right after) the cursor.
+    // Requires sort() to have been called.
+    const Entry* find(int line, int col) const;
+
+    // Comma-separated JSON objects {line,col,endLine,endCol,decl:{...}}
+    void writeJson(std::ostringstream& out) const;
+
+    // Declaration location {line,col,endLine,endCol,kind}; imports also carry
+    // "module" and, for selective imports, the imported "name". Bindings
+    // destructured from require("module") carry "module" and their "name".
+    static void writeDeclaration(std::ostringstream& out, const Entry& e);
+
+    // Group the entries by symbol and locate the declaration names.
+    // Requires sort() to have been called.
+    void indexUses(const std::string& source, const std::vector<size_t>& lineOffsets,
+                   const IdentifierIndex& identifiers);
+    bool hasUseIndex() const { return usesIndexed; }
+
+    // Bytes held by the index
+    size_t memoryUsage() const;
+
+    // {"found":true,"name","kind","renamable","declaration":{...},"references":[...]}
+    // for the symbol referenced or declared under the cursor, ranges as
+    // {line,col,endLine,endCol}. The declaration is left out when its name
+    // could not be located; such symbols, selective imports without an alias
+    // and bindings destructured from require() are not renamable.
+    // Requires indexUses().
+    void writeReferences(std::ostringstream& out, int line, int col) const;
+
+private:
+    struct Declaration {
+        SQCompilation::Node* decl;
+        const char* name;
+        const char* kind;
+        const char* module;
+        NameSite site;
+        int line, col;  // Located name start, line 0 if not found
+    };
+
+    std::vector<Entry> refs;
+    std::vector<Declaration> decls;  // Traversal order until indexUses orders them by symbol
+
+    // Built by indexUses
+    bool usesIndexed = false;
+    std::vector<uint32_t> uses;            // refs indices by symbol, then position
+    std::vector<uint32_t> declsByPosition;  // Located decls indices by name position
+
+    const Declaration* findDeclarationName(int line, int col) const;
+    const Declaration* declarationOf(SQCompilation::Node* decl, const char* name) const;
+};
@@ -0,0 +1,98 @@
+#include "diagnostics.h"
+#include <string.h>
+#include "utils.h"
+#include "profile.h"
+
+
+// Typical analyses report a few dozen messages, avoid regrowing for those
+static const size_t RESERVED_MESSAGES = 64;
+static const size_t RESERVED_POOL = 4096;
+
+
+DiagnosticBuffer::DiagnosticBuffer() {
+    line.reserve(RESERVED_MESSAGES);
+    col.reserve(RESERVED_MESSAGES);
+    len.reserve(RESERVED_MESSAGES);
+    intId.reserve(RESERVED_MESSAGES);
+    isError.reserve(RESERVED_MESSAGES);
+    strings.reserve(RESERVED_MESSAGES * STRINGS_PER_MESSAGE);
+    pool.reserve(RESERVED_POOL);
+}
+
+void DiagnosticBuffer::clear() {
+    line.clear();
+    col.clear();
+    len.clear();
+    intId.clear();
+    isError.clear();
+    strings.clear();
+    pool.clear();
+}
+
+void DiagnosticBuffer::addString(const char* s) {
+    size_t n = s ? strlen(s) : 0;
+    strings.push_back((int32_t)pool.size());
+    strings.push_back((int32_t)n);
+    pool.append(s ? s : "", n);
+}
+
+void DiagnosticBuffer::add(const SQCompilerMessage* msg) {
+    line.push_back(msg->line);
+    col.push_back(msg->column);
+    len.push_back(msg->columnsWidth);
+    intId.push_back(msg->intId);
+    isError.push_back(msg->isError ? 1 : 0);
+    addString(msg->message);
+    addString(msg->textId);
+    addString(msg->fileName);
+}
+
+void DiagnosticBuffer::append(const DiagnosticBuffer& other) {
+    int32_t base = (int32_t)pool.size();
+    line.insert(line.end(), other.line.begin(), other.line.end());
+    col.insert(col.end(), other.col.begin(), other.col.end());
+    len.insert(len.end(), other.len.begin(), other.len.end());
+    intId.insert(intId.end(), other.intId.begin(), other.intId.end());
+    isError.insert(isError.end(), other.isError.begin(), other.isError.end());
+    for (size_t i = 0; i < other.strings.size(); i += 2) {
+        strings.push_back(other.strings[i] + base);
+        strings.push_back(other.strings[i + 1]);
+    }
+    pool.append(other.pool);
+}
+
+void DiagnosticBuffer::appendMessage(const DiagnosticBuffer& other, size_t i, int lineShift) {
+    line.push_back(other.line[i] + lineShift);
+    col.push_back(other.col[i]);
+    len.push_back(other.len[i]);
+    intId.push_back(other.intId[i]);
+    isError.push_back(other.isError[i]);
+    for (size_t which = 0; which < STRINGS_PER_MESSAGE / 2; ++which) {
+        const int32_t* s = &other.strings[i * STRINGS_PER_MESSAGE + which * 2];
+        strings.push_back((int32_t)pool.size());
+        strings.push_back(s[1]);
+        pool.append(other.pool, s[0], s[1]);
+    }
+}
+
+void DiagnosticBuffer::writeJson(std::ostringstream& out) const {
+    ProfileScope profile(PROFILE_SERIALIZE);
+    auto str = [this](size_t i, int which) {
+        const int32_t* s = &strings[i * STRINGS_PER_MESSAGE + which * 2];
+        return escapeJson(pool.substr(s[0], s[1]).c_str());
+    };
+
+    for (size_t i = 0; i < size(); ++i) {
+        if (i > 0) out << ",";
+        out << "{"
+            << "\"line\":" << line[i]
+            << ",\"col\":" << col[i]
+            << ",\"len\":" << len[i]
+            << ",\"file\":\"" << str(i, 2) << "\""
+            << ",\"intId\":" << intId[i]
+            << ",\"textId\":\"" << str(i, 1) << "\""
+            << ",\"message\":\"" << str(i, 0) << "\""
+            << ",\"isError\":" << (isError[i] ? "true" : "false")
+            << "}";
+    }
+}
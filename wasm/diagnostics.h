@@ -0,0 +1,41 @@
+#pragma once
+
+#include "squirrel.h"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+// Compiler and analyzer messages as parallel arrays plus one string pool.
+// Messages are appended as they are reported, without formatting, and JS
+// reads the arrays through typed array views.
+struct DiagnosticBuffer {
+    std::vector<int32_t> line;     // 1-based
+    std::vector<int32_t> col;      // 0-based
+    std::vector<int32_t> len;
+    std::vector<int32_t> intId;    // -1 for parse errors
+    std::vector<int32_t> isError;  // 0 or 1
+
+    // Per message: offset and byte length in pool of message, textId, fileName
+    std::vector<int32_t> strings;
+    std::string pool;              // UTF-8, not terminated between strings
+
+    static const int STRINGS_PER_MESSAGE = 6;
+
+    DiagnosticBuffer();
+
+    size_t size() const { return line.size(); }
+    void clear();
+
+    void add(const SQCompilerMessage* msg);
+    void append(const DiagnosticBuffer& other);
+    // Message i of other, lineShift lines further down
+    void appendMessage(const DiagnosticBuffer& other, size_t i, int lineShift = 0);
+
+    // Comma-separated JSON objects {line,col,len,file,intId,textId,message,isError}
+    void writeJson(std::ostringstream& out) const;
+
+private:
+    void addString(const char* s);
+};
@@ -0,0 +1,530 @@
+#include "document.h"
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include "utils.h"
+#include "resolver.h"
+#include "profile.h"
+#include "scan.h"
+#include "arena.h"
+
+
+using namespace SQCompilation;
+
+
+static void compileErrorHandler(HSQUIRRELVM v, SQMessageSeverity /*sev*/,
+    const char* desc, const char* /*source*/,
+    SQInteger line, SQInteger column, const char* /*extra*/)
+{
+    DocumentSession* doc = static_cast<DocumentSession*>(sq_getforeignptr(v));
+    if (!doc || !doc->parseError.empty()) return;
+
+    std::ostringstream err;
+    err << "Line " << line << ":" << column << ": " << desc;
+    doc->parseError = err.str();
+}
+
+
+// All diagnostics (parse errors + static analysis) come through this callback.
+// The session is bound to its VM via the foreign pointer, and the call that
+// runs the compiler points diagSink at its own buffer.
+static void diagnosticHandler(HSQUIRRELVM v, const SQCompilerMessage* msg) {
+    DocumentSession* doc = static_cast<DocumentSession*>(sq_getforeignptr(v));
+    if (!doc) return;
+
+    if (msg->isError && doc->parseError.empty()) {
+        std::ostringstream err;
+        err << "Line " << msg->line << ":" << msg->column << ": " << msg->message;
+        doc->parseError = err.str();
+    }
+
+    if (doc->diagSink) {
+        doc->diagSink->add(msg);
+    }
+}
+
+
+// Sessions only use the compiler front end of their VM, but sq_open builds
+// the whole runtime (shared state, root table, default delegates) and
+// sq_close tears it down again. Released VMs are kept and handed to the
+// next session instead. Strings the compiler interns stay in a VM's string
+// table, so a VM is closed after a number of sessions to keep it small.
+// Pools are per thread, for the linter's worker threads (lint.cpp).
+static const size_t IDLE_VM_LIMIT = 4;
+static const int VM_SESSION_LIMIT = 256;
+static const SQInteger VM_STACK_SIZE = 256;
+
+struct IdleVm {
+    HSQUIRRELVM vm;
+    int sessions;  // Sessions that used it so far
+};
+struct IdleVms : std::vector<IdleVm> {
+    ~IdleVms();
+};
+static thread_local IdleVms idleVms;
+static thread_local bool idleVmsGone = false;  // Sessions outliving the pool at thread exit
+
+static HSQUIRRELVM acquireVm(int& sessions) {
+    if (!idleVmsGone && !idleVms.empty()) {
+        IdleVm idle = idleVms.back();
+        idleVms.pop_back();
+        sessions = idle.sessions + 1;
+        return idle.vm;
+    }
+    sessions = 1;
+    return sq_open(VM_STACK_SIZE);
+}
+
+static void releaseVm(HSQUIRRELVM vm, int sessions) {
+    if (idleVmsGone || idleVms.size() >= IDLE_VM_LIMIT || sessions >= VM_SESSION_LIMIT) {
+        sq_close(vm);
+        return;
+    }
+    sq_setforeignptr(vm, nullptr);
+    sq_settop(vm, 0);
+    idleVms.push_back({vm, sessions});
+}
+
+static void closeIdleVms() {
+    for (const IdleVm& idle : idleVms) {
+        sq_close(idle.vm);
+    }
+    idleVms.clear();
+}
+
+IdleVms::~IdleVms() {
+    for (const IdleVm& idle : *this) {
+        sq_close(idle.vm);
+    }
+    idleVmsGone = true;
+}
+
+
+DocumentSession::DocumentSession(const std::string& src)
+    : source(src), vm(nullptr), astData(nullptr), parsed(false), diagSink(nullptr)
+    , packedTokensFull(false), deltaBaseId(0), tokensDelta()
+    , lastUsed(0), pinned(false), measuredBytes(0)
+    , lineIndexValid(false), identifierIndexValid(false), sourceHash(0), sourceHashValid(false)
+    , vmSessions(0), outlineIdBase(0) {
+    vm = acquireVm(vmSessions);
+    if (vm) {
+        sq_setforeignptr(vm, this);
+        sq_setcompilererrorhandler(vm, compileErrorHandler);
+        sq_setcompilerdiaghandler(vm, diagnosticHandler);
+    }
+}
+
+DocumentSession::~DocumentSession() {
+    releaseAst();
+    if (vm) releaseVm(vm, vmSessions);
+}
+
+void DocumentSession::releaseAst() {
+    if (astData) {
+        sq_releaseASTData(vm, astData);
+        astData = nullptr;
+    }
+    declarations.reset();
+    // Ids of this AST are never handed out again
+    outlineIdBase += (int)outlineEntries.size();
+    outlineEntries.clear();
+    outlineIds.clear();
+    packedTokensFull = false;
+    parsed = false;
+}
+
+void DocumentSession::setSource(const std::string& src) {
+    releaseAst();
+    source = src;
+    lineIndexValid = false;
+    identifierIndexValid = false;
+    sourceHashValid = false;
+}
+
+void DocumentSession::buildLineIndex() {
+    lineOffsets.clear();
+    lineOffsets.push_back(0);  // Line 1 starts at offset 0
+    appendLineStarts(source.data(), source.size(), 0, lineOffsets);
+    lineIndexValid = true;
+}
+
+const std::vector<size_t>& DocumentSession::lines() {
+    if (!lineIndexValid) buildLineIndex();
+    return lineOffsets;
+}
+
+const IdentifierIndex& DocumentSession::identifiers() {
+    if (!identifierIndexValid) {
+        identifierIndex.build(source);
+        identifierIndexValid = true;
+    }
+    return identifierIndex;
+}
+
+// Convert editor position (UTF-16 column) to a byte offset in UTF-8 source
+size_t DocumentSession::offsetAt(int line, int character) {
+    const std::vector<size_t>& idx = lines();
+    if (line < 1) return 0;
+    if (line > (int)idx.size()) return source.size();
+
+    size_t pos = idx[line - 1];
+    size_t lineEnd = (line < (int)idx.size()) ? idx[line] - 1 : source.size();
+
+    for (int units = 0; units < character && pos < lineEnd; ) {
+        unsigned char c = (unsigned char)source[pos];
+        int seqLen = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+        units += (seqLen == 4) ? 2 : 1;  // 4-byte sequences are surrogate pairs in UTF-16
+        pos += seqLen;
+    }
+    return pos < lineEnd ? pos : lineEnd;
+}
+
+bool DocumentSession::applyEdit(int startLine, int startChar, int endLine, int endChar, const std::string& text) {
+    const std::vector<size_t>& idx = lines();
+    if (startLine < 1 || endLine < startLine || endLine > (int)idx.size()) return false;
+
+    size_t start = offsetAt(startLine, startChar);
+    size_t end = offsetAt(endLine, endChar);
+    if (end < start) return false;
+
+    releaseAst();
+    source.replace(start, end - start, text);
+    identifierIndexValid = false;
+    sourceHashValid = false;
+
+    // Patch line index: drop line starts inside the replaced range,
+    // add the ones from inserted text and shift everything after it
+    std::vector<size_t> inserted;
+    appendLineStarts(text.data(), text.size(), start, inserted);
+
+    auto first = lineOffsets.begin() + startLine;  // First line start after edit start
+    auto last = lineOffsets.begin() + endLine;      // First line start after edit end
+    ptrdiff_t delta = (ptrdiff_t)text.size() - (ptrdiff_t)(end - start);
+    for (auto it = last; it != lineOffsets.end(); ++it) {
+        *it = (size_t)((ptrdiff_t)*it + delta);
+    }
+
+    auto pos = lineOffsets.erase(first, last);
+    lineOffsets.insert(pos, inserted.begin(), inserted.end());
+    return true;
+}
+
+uint64_t DocumentSession::textHash() {
+    if (!sourceHashValid) {
+        sourceHash = hashBytes(source.data(), source.size());
+        sourceHashValid = true;
+    }
+    return sourceHash;
+}
+
+static const size_t ANALYSIS_CACHE_SIZE = 4;
+
+const DiagnosticBuffer* DocumentSession::findAnalysis(uint64_t configKey) {
+    uint64_t hash = textHash();
+    for (size_t i = 0; i < analysisCache.size(); ++i) {
+        const AnalysisResult& cached = analysisCache[i];
+        if (cached.textHash == hash && cached.textLength == source.size() && cached.configKey == configKey) {
+            // Move to front
+            std::rotate(analysisCache.begin(), analysisCache.begin() + i, analysisCache.begin() + i + 1);
+            return &analysisCache.front().messages;
+        }
+    }
+    return nullptr;
+}
+
+const DiagnosticBuffer& DocumentSession::storeAnalysis(uint64_t configKey, DiagnosticBuffer&& messages) {
+    if (analysisCache.size() >= ANALYSIS_CACHE_SIZE) {
+        analysisCache.pop_back();
+    }
+    analysisCache.insert(analysisCache.begin(), {textHash(), source.size(), configKey, std::move(messages)});
+    return analysisCache.front().messages;
+}
+
+SqASTData* DocumentSession::ast() {
+    if (parsed) return astData;
+    if (!vm) return nullptr;
+
+    parsed = true;
+    parseError.clear();
+    parseMessages.clear();
+
+    diagSink = &parseMessages;
+    {
+        ProfileScope profile(PROFILE_PARSE);
+        astData = sq_parsetoast(vm, source.c_str(), source.length(),
+                                "document", SQFalse, SQFalse);
+    }
+    diagSink = nullptr;
+
+    if (astData && !astData->root) {
+        sq_releaseASTData(vm, astData);
+        astData = nullptr;
+    }
+    if (!astData && parseError.empty()) {
+        parseError = "Parse failed";
+    }
+    return astData;
+}
+
+const DeclarationMap* DocumentSession::declarationIndex() {
+    if (declarations) return declarations.get();
+
+    SqASTData* astData = ast();
+    if (!astData) return nullptr;
+
+    std::unique_ptr<DeclarationMap> map(new DeclarationMap());
+    ScopeResolver resolver;
+    resolver.addListener(map.get());
+    {
+        ProfileScope profile(PROFILE_WALK);
+        astData->root->visit(&resolver);
+    }
+    if (resolver.isCancelled()) return nullptr;
+    map->sort();
+
+    declarations = std::move(map);
+    return declarations.get();
+}
+
+const DeclarationMap* DocumentSession::referenceIndex() {
+    if (!declarationIndex()) return nullptr;
+    if (!declarations->hasUseIndex()) declarations->indexUses(source, lines(), identifiers());
+    return declarations.get();
+}
+
+// The AST is allocated inside the compiler, its size is not reported
+static const size_t AST_BYTES_PER_SOURCE_BYTE = 12;
+// Node and bucket of an unordered_map entry
+static const size_t HASH_ENTRY_OVERHEAD = 2 * sizeof(void*);
+
+template<typename T>
+static size_t capacityBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+static size_t diagnosticBytes(const DiagnosticBuffer& d) {
+    return capacityBytes(d.line) + capacityBytes(d.col) + capacityBytes(d.len) + capacityBytes(d.intId)
+        + capacityBytes(d.isError) + capacityBytes(d.strings) + d.pool.capacity();
+}
+
+static size_t tokenBytes(const PackedSemanticTokens& t) {
+    return capacityBytes(t.data) + capacityBytes(t.nameIds) + capacityBytes(t.nameHashes);
+}
+
+size_t DocumentSession::memoryUsage() const {
+    size_t bytes = sizeof(*this) + source.capacity() + capacityBytes(lineOffsets)
+        + capacityBytes(identifierIndex.tokens())
+        + (astData ? source.size() * AST_BYTES_PER_SOURCE_BYTE : 0)
+        + (declarations ? declarations->memoryUsage() : 0)
+        + capacityBytes(outlineEntries)
+        + outlineIds.size() * (sizeof(std::pair<Node* const, int>) + HASH_ENTRY_OVERHEAD)
+        + tokenBytes(packedTokens) + tokenBytes(rangeTokens) + capacityBytes(deltaBase)
+        + diagnosticBytes(parseMessages);
+    for (const AnalysisResult& cached : analysisCache) {
+        bytes += sizeof(cached) + diagnosticBytes(cached.messages);
+    }
+    bytes += capacityBytes(unitAnalyses) + diagnosticBytes(unitMessages) + capacityBytes(flaggedNames);
+    for (const std::string& name : flaggedNames) {
+        bytes += name.capacity();
+    }
+    return bytes;
+}
+
+void DocumentSession::trim() {
+    releaseAst();
+    // Swapped out, clear() would keep the capacity
+    std::vector<OutlineEntry>().swap(outlineEntries);
+    std::unordered_map<Node*, int>().swap(outlineIds);
+    packedTokens = PackedSemanticTokens();
+    rangeTokens = PackedSemanticTokens();
+    std::vector<int32_t>().swap(deltaBase);
+    deltaBaseId = 0;
+    parseMessages = DiagnosticBuffer();
+    std::vector<AnalysisResult>().swap(analysisCache);
+    std::vector<UnitAnalysis>().swap(unitAnalyses);
+    unitMessages = DiagnosticBuffer();
+    std::vector<std::string>().swap(flaggedNames);
+    identifierIndex = IdentifierIndex();
+    identifierIndexValid = false;
+}
+
+int DocumentSession::outlineId(Node* owner, OutlineSource source) {
+    auto res = outlineIds.emplace(owner, outlineIdBase + (int)outlineEntries.size() + 1);
+    if (res.second) outlineEntries.push_back({owner, source});
+    return res.first->second;
+}
+
+const DocumentSession::OutlineEntry* DocumentSession::outlineEntry(int id) const {
+    int index = id - outlineIdBase - 1;
+    return index >= 0 && index < (int)outlineEntries.size() ? &outlineEntries[index] : nullptr;
+}
+
+
+static std::unordered_map<int, std::unique_ptr<DocumentSession>> documents;
+
+// Memory policy, see setMemoryBudget
+static size_t memoryBudget = 0;  // Bytes, 0 for no limit
+static uint64_t useCount = 0;
+static int evictions = 0;        // Sessions trimmed so far
+
+// Sum of the sessions' measuredBytes. Sizes only change during calls on a
+// session, so the one looked up last is measured again when the next
+// lookup starts and every other size stays valid.
+static size_t documentBytes = 0;
+static DocumentSession* lastTouched = nullptr;
+static size_t stuckTotal = 0;    // Total the last trim pass could not bring under budget
+
+static void measure(DocumentSession* doc) {
+    size_t bytes = doc->memoryUsage();
+    documentBytes = documentBytes - doc->measuredBytes + bytes;
+    doc->measuredBytes = bytes;
+}
+
+// Trim the least recently used sessions other than current until the open
+// documents fit in the budget. WASM memory never shrinks, but freed space
+// is reused, so this caps the heap at about the budget plus one document.
+static void enforceMemoryBudget(DocumentSession* current) {
+    if (memoryBudget == 0 || documentBytes <= memoryBudget || documentBytes == stuckTotal) return;
+
+    std::vector<DocumentSession*> candidates;
+    for (const auto& entry : documents) {
+        DocumentSession* doc = entry.second.get();
+        if (doc != current && !doc->pinned) candidates.push_back(doc);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const DocumentSession* a, const DocumentSession* b) {
+        return a->lastUsed < b->lastUsed;
+    });
+    for (DocumentSession* doc : candidates) {
+        if (documentBytes <= memoryBudget) break;
+        size_t before = doc->measuredBytes;
+        doc->trim();
+        measure(doc);
+        if (doc->measuredBytes < before) ++evictions;
+    }
+
+    // Still over: give back what is only kept for speed
+    if (documentBytes > memoryBudget) {
+        closeIdleVms();
+        scratchArena().shrink();
+        stuckTotal = documentBytes;
+    }
+}
+
+static void touch(DocumentSession* doc) {
+    doc->lastUsed = ++useCount;
+    if (lastTouched && lastTouched != doc) measure(lastTouched);
+    measure(doc);
+    lastTouched = doc;
+    enforceMemoryBudget(doc);
+}
+
+DocumentSession* openDocumentSession(int docId, const std::string& source) {
+    std::unique_ptr<DocumentSession>& doc = documents[docId];
+    if (doc) {
+        doc->setSource(source);
+    } else {
+        doc.reset(new DocumentSession(source));
+    }
+    touch(doc.get());
+    return doc.get();
+}
+
+DocumentSession* findDocumentSession(int docId) {
+    auto it = documents.find(docId);
+    if (it == documents.end()) return nullptr;
+    touch(it->second.get());
+    return it->second.get();
+}
+
+void closeDocumentSession(int docId) {
+    auto it = documents.find(docId);
+    if (it == documents.end()) return;
+    documentBytes -= it->second->measuredBytes;
+    if (lastTouched == it->second.get()) lastTouched = nullptr;
+    documents.erase(it);
+}
+
+void closeAllDocumentSessions() {
+    documents.clear();
+    documentBytes = 0;
+    lastTouched = nullptr;
+    stuckTotal = 0;
+    closeIdleVms();
+}
+
+
+// Exported document-handle API
+
+bool openDocument(int docId, const std::string& source) {
+    DocumentSession* doc = openDocumentSession(docId, source);
+    return doc->vm != nullptr;
+}
+
+bool updateDocument(int docId, const std::string& source) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc) return false;
+    doc->setSource(source);
+    return true;
+}
+
+bool editDocument(int docId, int startLine, int startChar, int endLine, int endChar, const std::string& text) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc) return false;
+    return doc->applyEdit(startLine, startChar, endLine, endChar, text);
+}
+
+void closeDocument(int docId) {
+    closeDocumentSession(docId);
+}
+
+void setMemoryBudget(int budgetMb) {
+    memoryBudget = budgetMb > 0 ? size_t(budgetMb) * 1024 * 1024 : 0;
+    stuckTotal = 0;
+    if (lastTouched) measure(lastTouched);
+    enforceMemoryBudget(nullptr);
+}
+
+void setDocumentPinned(int docId, bool pinned) {
+    auto it = documents.find(docId);
+    if (it != documents.end()) it->second->pinned = pinned;
+}
+
+std::string memoryStats() {
+    struct DocumentSize {
+        size_t bytes;
+        int docId;
+        const DocumentSession* doc;
+    };
+    std::vector<DocumentSize> sizes;
+    size_t total = 0;
+    for (const auto& entry : documents) {
+        size_t bytes = entry.second->memoryUsage();
+        sizes.push_back({bytes, entry.first, entry.second.get()});
+        total += bytes;
+    }
+    // Largest first
+    std::sort(sizes.begin(), sizes.end(), [](const DocumentSize& a, const DocumentSize& b) {
+        return a.bytes > b.bytes;
+    });
+
+    std::ostringstream out;
+    out << "{\"budget\":" << memoryBudget
+        << ",\"documentBytes\":" << total
+        << ",\"heapSize\":" << heapSize()
+        << ",\"heapInUse\":" << heapInUse()
+        << ",\"scratchArena\":" << scratchArena().reserved()
+        << ",\"idleVms\":" << idleVms.size()
+        << ",\"evictions\":" << evictions
+        << ",\"documents\":[";
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        const DocumentSession* doc = sizes[i].doc;
+        if (i > 0) out << ",";
+        out << "{\"id\":" << sizes[i].docId
+            << ",\"bytes\":" << sizes[i].bytes
+            << ",\"parsed\":" << (doc->astData ? "true" : "false")
+            << ",\"pinned\":" << (doc->pinned ? "true" : "false")
+            << "}";
+    }
+    out << "]}";
+    return out.str();
+}
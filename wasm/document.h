@@ -0,0 +1,183 @@
+#pragma once
+
+#include "squirrel.h"
+#include "compiler/compiler.h"
+#include "compiler/ast.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include "declaration_map.h"
+#include "identifier_index.h"
+#include "diagnostics.h"
+
+
+// Semantic tokens in the delta-encoded layout of vs.SemanticTokens
+// (deltaLine, deltaStartChar, length, tokenType, tokenModifiers),
+// plus the identifier of each token as an index into a name table
+struct PackedSemanticTokens {
+    std::vector<int32_t> data;
+    std::vector<int32_t> nameIds;
+    // Per distinct name, in order of first occurrence: the 31-multiplier
+    // hash of its UTF-16 code units (Java's String.hashCode). The extension
+    // picks palette colors from it, names themselves never leave the engine.
+    std::vector<int32_t> nameHashes;
+};
+
+// Token data of a document against the result the caller has, in the
+// layout of vs.SemanticTokensEdit: `size` ints at `data` replace
+// `deleteCount` ints from `start` of the previous result
+struct SemanticTokensDelta {
+    int resultId;
+    bool full;         // No usable previous result, data is the whole array
+    int start;
+    int deleteCount;
+    const int32_t* data;
+    size_t size;
+};
+
+
+// Where the children of an outline symbol are read from
+enum OutlineSource {
+    OUTLINE_BODY,     // Declarations in a function body
+    OUTLINE_MEMBERS,  // Named members of a class or table
+    OUTLINE_ENUM,     // Constants of an enum
+};
+
+
+// Parse session of one open document.
+// Keeps a VM (taken from a pool of reused VMs) and the parsed AST alive so that outline, diagnostics,
+// declaration and semantic token queries share a single sq_parsetoast
+// until the document text changes.
+struct DocumentSession {
+    std::string source;
+    HSQUIRRELVM vm;
+    SqASTData* astData;
+    bool parsed;  // astData and parse results reflect current source
+
+    std::string parseError;     // First parse error as "Line L:C: message"
+    DiagnosticBuffer parseMessages;  // Diagnostics reported while parsing
+    DiagnosticBuffer* diagSink;      // Where the diagnostic handler adds messages during a call
+
+    // Sorted identifier -> declaration index of the current AST, built on first lookup
+    std::unique_ptr<DeclarationMap> declarations;
+
+    // Outline symbols handed out collapsed (see documentOutline)
+    struct OutlineEntry {
+        SQCompilation::Node* owner;
+        OutlineSource source;
+    };
+
+    PackedSemanticTokens packedTokens;  // Last binary token result, referenced from JS memory views
+    bool packedTokensFull;              // packedTokens holds all tokens of the current text
+    PackedSemanticTokens rangeTokens;   // Same for line range requests
+
+    // Token data last handed out by documentSemanticTokensDelta
+    std::vector<int32_t> deltaBase;
+    int deltaBaseId;  // 0 if none
+    SemanticTokensDelta tokensDelta;
+
+    // Diagnostics of recently analyzed texts, most recent first, keyed by
+    // the full text: saving unchanged text or undoing back to an analyzed
+    // state costs nothing. configKey tells apart results under different
+    // analyzer configs.
+    struct AnalysisResult {
+        uint64_t textHash;
+        size_t textLength;
+        uint64_t configKey;
+        DiagnosticBuffer messages;
+    };
+    std::vector<AnalysisResult> analysisCache;
+
+    // Analyzer messages of each root statement with function bodies in the
+    // last analyzed text, for reanalyzing only the changed ones (see
+    // unit_analysis.h). Lines are relative to the statement's first line.
+    struct UnitAnalysis {
+        uint64_t key;
+        uint32_t first;  // Messages first..first + count - 1 of unitMessages
+        uint32_t count;
+    };
+    std::vector<UnitAnalysis> unitAnalyses;  // Ordered by key
+    DiagnosticBuffer unitMessages;
+    // Identifiers under the module-level messages of that analysis
+    std::vector<std::string> flaggedNames;
+
+    uint64_t lastUsed;  // Registry use count when last looked up, for eviction
+    bool pinned;        // Shown in an editor, never evicted
+    size_t measuredBytes;  // memoryUsage() when the registry last measured it
+
+    explicit DocumentSession(const std::string& src);
+    ~DocumentSession();
+
+    DocumentSession(const DocumentSession&) = delete;
+    DocumentSession& operator=(const DocumentSession&) = delete;
+
+    // Replace document text, dropping the parsed AST
+    void setSource(const std::string& src);
+
+    // Replace a range of the text in place, as reported by an editor change.
+    // Lines are 1-based, characters are 0-based UTF-16 code unit offsets.
+    bool applyEdit(int startLine, int startChar, int endLine, int endChar, const std::string& text);
+
+    // Offset of each line start in source, kept up to date across edits
+    const std::vector<size_t>& lines();
+
+    // Identifier token positions of the current source, built on first use
+    const IdentifierIndex& identifiers();
+
+    // Hash of the current source, computed once per text version
+    uint64_t textHash();
+
+    // Parse and analyzer messages of the current text if analyzed before
+    // with the same analyzer config (see analyzerConfigKey)
+    const DiagnosticBuffer* findAnalysis(uint64_t configKey);
+    // Takes the messages over, returns the stored copy
+    const DiagnosticBuffer& storeAnalysis(uint64_t configKey, DiagnosticBuffer&& messages);
+
+    // Parse on first use after a text change.
+    // Returns nullptr if the document has syntax errors.
+    SqASTData* ast();
+
+    // Resolve all identifiers once per document version.
+    // Returns nullptr if the document has syntax errors.
+    const DeclarationMap* declarationIndex();
+    // The same index with uses grouped by declaration, for reference queries
+    const DeclarationMap* referenceIndex();
+
+    // Id of a collapsed outline symbol, the same for the same node until the
+    // AST is released. Ids are not reused, outlineEntry is nullptr for ids
+    // of an earlier AST (older text or trimmed session).
+    int outlineId(SQCompilation::Node* owner, OutlineSource source);
+    const OutlineEntry* outlineEntry(int id) const;
+
+    // Approximate bytes held by the session, the AST estimated from the text size
+    size_t memoryUsage() const;
+    // Drop everything that is rebuilt on demand: AST, indexes, token and
+    // analysis results. The text and line index stay.
+    void trim();
+
+private:
+    std::vector<size_t> lineOffsets;
+    bool lineIndexValid;
+    IdentifierIndex identifierIndex;
+    bool identifierIndexValid;
+    uint64_t sourceHash;
+    bool sourceHashValid;
+    int vmSessions;  // Sessions the pooled VM has served, this one included
+    int outlineIdBase;  // Ids handed out for earlier ASTs, outlineEntries[i] has id base + i + 1
+    std::vector<OutlineEntry> outlineEntries;
+    std::unordered_map<SQCompilation::Node*, int> outlineIds;
+
+    void releaseAst();
+    void buildLineIndex();
+    size_t offsetAt(int line, int character);
+};
+
+
+// Open documents keyed by the extension-side document id
+DocumentSession* openDocumentSession(int docId, const std::string& source);
+DocumentSession* findDocumentSession(int docId);
+void closeDocumentSession(int docId);
+// Also closes the VMs kept for reuse
+void closeAllDocumentSessions();
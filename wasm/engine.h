@@ -0,0 +1,53 @@
+#pragma once
+
+// Entry points of the engine, bound to JS by native.cpp (WASM, embind)
+// and by napi.cpp (Node addon). Both layers expose the same functions
+// under the same names.
+
+#include <string>
+#include "document.h"
+#include "analyzer_config.h"
+#include "profile.h"
+#include "batch.h"
+
+
+std::string parseAndExtractSymbols(const std::string& source);
+std::string analyzeCode(const std::string& source);
+std::string findDeclarationAt(const std::string& source, int line, int col);
+std::string extractSemanticTokens(const std::string& source);
+std::string extractSemanticTokensRange(const std::string& source, int firstLine, int lastLine);
+
+// Document-handle API: the parsed AST is kept per document id
+// and shared by all queries until the text is updated
+bool openDocument(int docId, const std::string& source);
+bool updateDocument(int docId, const std::string& source);
+bool editDocument(int docId, int startLine, int startChar, int endLine, int endChar, const std::string& text);
+void closeDocument(int docId);
+// Once open documents take more than budgetMb megabytes (0 for no limit),
+// the least recently queried ones drop their AST, indexes and cached
+// results, to be rebuilt on their next query. Their text is kept, and
+// pinned documents (shown in an editor) are left alone.
+void setMemoryBudget(int budgetMb);
+void setDocumentPinned(int docId, bool pinned);
+// {"budget","documentBytes","heapSize","heapInUse","scratchArena","idleVms",
+// "evictions","documents":[{id,bytes,parsed,pinned}]}, sizes in bytes
+std::string memoryStats();
+std::string documentSymbols(int docId);
+// Outline symbols depth levels deep (0 for all) below the collapsed symbol
+// parentId, or below the top level for 0. Symbols at the last level that
+// have children carry "id" and "hasChildren". Ids stay valid until the text changes
+// or the session is trimmed (setMemoryBudget), later they are reported unknown.
+std::string documentOutline(int docId, int parentId, int depth);
+// configChain: newline-separated analyzer config paths, see analyzer_config.h
+std::string documentAnalyze(int docId, const std::string& configChain);
+std::string documentAnalyzeAll(int docId, const std::string& configChain);
+const DiagnosticBuffer* documentAnalyzePacked(int docId, const std::string& configChain);
+std::string documentFindDeclarationAt(int docId, int line, int col);
+// Declaration name and uses of the symbol under the cursor, in this document
+std::string documentFindReferences(int docId, int line, int col);
+std::string documentSemanticTokens(int docId);
+// Lines are 1-based and inclusive, lastLine 0 means the whole document
+const PackedSemanticTokens* documentSemanticTokensPacked(int docId, int firstLine, int lastLine);
+// Edit from the token data of previousResultId to the current tokens, or
+// all of them if that is not the last result returned for the document
+const SemanticTokensDelta* documentSemanticTokensDelta(int docId, int previousResultId);
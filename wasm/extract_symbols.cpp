@@ -3,39 +3,55 @@
 #include "compiler/ast.h"
 #include <sstream>
 #include <string>
+#include <vector>
+#include <limits.h>
 #include "utils.h"
+#include "document.h"
+#include "extract_symbols.h"
+#include "profile.h"
+#include "batch.h"
 
 
 using namespace SQCompilation;
 
 
-// Store last error message for parseAndExtractSymbols
-static std::string lastError;
-
-
-static void compileErrorHandler(HSQUIRRELVM /*v*/, SQMessageSeverity /*sev*/,
-    const char* desc, const char* /*source*/,
-    SQInteger line, SQInteger column, const char* /*extra*/)
-{
-    std::ostringstream err;
-    err << "Line " << line << ":" << column << ": " << desc;
-    lastError = err.str();
-}
-
-
-// Symbol extractor visitor that outputs JSON
+// Symbol extractor visitor that outputs JSON.
+// Everything is written to one stream as the walk goes: a "children" array
+// is only opened once its first symbol is found, so bodies without
+// declarations cost nothing. Below maxDepth levels symbols are not
+// expanded, those with children get an id to expand them later with.
 class SymbolExtractor : public Visitor {
+    struct Level {
+        bool first;   // No symbol written at this level yet
+        bool opened;  // The level's "children" array has been written
+    };
+
     std::ostringstream& out;
-    bool firstAtLevel[64];  // Track first element at each nesting level
-    int depth;
+    std::vector<Level> levels;  // Levels being written, the outermost is the result array
+    int maxDepth;
+    DocumentSession* ids;       // Where collapsed symbols get their ids, if anywhere
+
+    // Set while looking for any symbol below a collapsed one, nothing is written
+    bool probing;
+    bool probeFound;
 
     void startSymbol(const char* name, const char* kind, Node* node) {
         startSymbolWithRange(name, kind, node, node);
     }
 
     void startSymbolWithRange(const char* name, const char* kind, Node* startNode, Node* endNode) {
-        if (!firstAtLevel[depth]) out << ",";
-        firstAtLevel[depth] = false;
+        if (probing) {
+            probeFound = true;
+            return;
+        }
+
+        Level& level = levels.back();
+        if (!level.opened) {
+            out << ",\"children\":[";
+            level.opened = true;
+        }
+        if (!level.first) out << ",";
+        level.first = false;
 
         out << "{\"name\":\"" << escapeJson(name) << "\""
             << ",\"kind\":\"" << kind << "\""
@@ -47,19 +63,71 @@ class SymbolExtractor : public Visitor {
             << "}";
     }
 
-    void startChildren() {
-        out << ",\"children\":[";
-        depth++;
-        if (depth < 64) firstAtLevel[depth] = true;
+    void endSymbol() {
+        if (!probing) out << "}";
     }
 
-    void endChildren() {
-        out << "]";
-        depth--;
+    // Children of the symbol just started, from owner (see OutlineSource)
+    void emitChildren(Node* owner, OutlineSource source) {
+        if (probing) return;
+
+        if ((int)levels.size() >= maxDepth) {
+            if (ids && hasChildren(owner, source)) {
+                out << ",\"id\":" << ids->outlineId(owner, source) << ",\"hasChildren\":true";
+            }
+            return;
+        }
+
+        levels.push_back({true, false});
+        emitChildrenOf(owner, source);
+        if (levels.back().opened) out << "]";
+        levels.pop_back();
     }
 
-    void endSymbol() {
-        out << "}";
+    void emitChildrenOf(Node* owner, OutlineSource source) {
+        switch (source) {
+            case OUTLINE_BODY: {
+                FunctionExpr* fn = static_cast<FunctionExpr*>(owner);
+                if (fn->body()) fn->body()->visit(this);
+                break;
+            }
+            case OUTLINE_MEMBERS:
+                for (const auto& member : static_cast<TableExpr*>(owner)->members()) {
+                    emitTableMember(member);
+                }
+                break;
+            case OUTLINE_ENUM: {
+                EnumDecl* enm = static_cast<EnumDecl*>(owner);
+                for (const auto& c : enm->consts()) {
+                    // Use enum node location since consts don't have their own location
+                    startSymbol(c.id, "EnumMember", enm);
+                    endSymbol();
+                }
+                break;
+            }
+        }
+    }
+
+    bool hasChildren(Node* owner, OutlineSource source) {
+        switch (source) {
+            case OUTLINE_BODY: {
+                FunctionExpr* fn = static_cast<FunctionExpr*>(owner);
+                if (!fn->body()) return false;
+                probing = true;
+                probeFound = false;
+                fn->body()->visit(this);
+                probing = false;
+                return probeFound;
+            }
+            case OUTLINE_MEMBERS:
+                for (const auto& member : static_cast<TableExpr*>(owner)->members()) {
+                    if (getMemberName(member.key)) return true;
+                }
+                return false;
+            case OUTLINE_ENUM:
+                return !static_cast<EnumDecl*>(owner)->consts().empty();
+        }
+        return false;
     }
 
     // Get name from class key expression
@@ -84,34 +152,6 @@ class SymbolExtractor : public Visitor {
         return nullptr;
     }
 
-    // Visit a node and collect its children as a JSON string
-    // Returns empty string if no children found
-    std::string collectChildren(Node* node) {
-        if (!node) return "";
-
-        std::ostringstream childOut;
-        std::swap(out, childOut);
-        bool savedFirst = firstAtLevel[depth];
-        firstAtLevel[depth] = true;
-
-        node->visit(this);
-
-        std::swap(out, childOut);
-        firstAtLevel[depth] = savedFirst;
-
-        return childOut.str();
-    }
-
-    // Visit a function/method body and emit children if any exist
-    void visitFunctionBody(FunctionExpr* fn) {
-        if (!fn->body()) return;
-
-        std::string children = collectChildren(fn->body());
-        if (!children.empty()) {
-            out << ",\"children\":[" << children << "]";
-        }
-    }
-
     // Emit a table/class member (shared by class, table, const, and var handling)
     void emitTableMember(const TableMember& member) {
         const char* memberName = getMemberName(member.key);
@@ -123,7 +163,7 @@ class SymbolExtractor : public Visitor {
             FunctionExpr* method = static_cast<FunctionExpr*>(val);
             bool isCtor = method->name() && strcmp(method->name(), "constructor") == 0;
             startSymbol(memberName, isCtor ? "Constructor" : "Method", val);
-            visitFunctionBody(method);
+            emitChildren(method, OUTLINE_BODY);
             endSymbol();
         } else {
             startSymbol(memberName, member.isStatic() ? "Property" : "Field", member.key);
@@ -133,20 +173,8 @@ class SymbolExtractor : public Visitor {
 
     // Emit children for a complex initializer (table or class)
     void emitInitializerChildren(Expr* init) {
-        if (!init) return;
-
-        if (init->op() == TO_TABLE || init->op() == TO_CLASS) {
-            TableExpr* tbl = static_cast<TableExpr*>(init);
-            bool hasMembers = false;
-            for (const auto& member : tbl->members()) {
-                if (!getMemberName(member.key)) continue;
-                if (!hasMembers) {
-                    startChildren();
-                    hasMembers = true;
-                }
-                emitTableMember(member);
-            }
-            if (hasMembers) endChildren();
+        if (init && (init->op() == TO_TABLE || init->op() == TO_CLASS)) {
+            emitChildren(init, OUTLINE_MEMBERS);
         }
     }
 
@@ -157,11 +185,17 @@ class SymbolExtractor : public Visitor {
     }
 
 public:
-    SymbolExtractor(std::ostringstream& o) : out(o), depth(0) {
-        for (int i = 0; i < 64; i++) firstAtLevel[i] = true;
+    // maxDepth: levels of symbols to write, ids: session to number collapsed symbols in
+    explicit SymbolExtractor(std::ostringstream& o, int maxDepth_ = INT_MAX, DocumentSession* ids_ = nullptr)
+        : out(o), levels(1, Level{true, true}), maxDepth(maxDepth_), ids(ids_), probing(false), probeFound(false) {}
+
+    // Symbols below owner, as the children of the symbol it was given an id for
+    void writeChildren(Node* owner, OutlineSource source) {
+        emitChildrenOf(owner, source);
     }
 
     virtual void visitNode(Node* node) override {
+        if (probing && probeFound) return;
         TreeOp op = node->op();
 
         switch (op) {
@@ -181,7 +215,7 @@ public:
                 if (!name || !*name) break;
 
                 startSymbol(name, "Function", fn);
-                visitFunctionBody(fn);
+                emitChildren(fn, OUTLINE_BODY);
                 endSymbol();
                 break;
             }
@@ -189,19 +223,7 @@ public:
             case TO_CLASS: {
                 ClassExpr* cls = static_cast<ClassExpr*>(node);
                 startSymbol(getClassName(cls), "Class", cls);
-
-                // Emit class members as children
-                bool hasMembers = false;
-                for (const auto& member : cls->members()) {
-                    if (!getMemberName(member.key)) continue;
-                    if (!hasMembers) {
-                        startChildren();
-                        hasMembers = true;
-                    }
-                    emitTableMember(member);
-                }
-                if (hasMembers) endChildren();
-
+                emitChildren(cls, OUTLINE_MEMBERS);
                 endSymbol();
                 break;
             }
@@ -209,17 +231,7 @@ public:
             case TO_ENUM: {
                 EnumDecl* enm = static_cast<EnumDecl*>(node);
                 startSymbol(enm->name(), "Enum", enm);
-
-                if (!enm->consts().empty()) {
-                    startChildren();
-                    for (const auto& c : enm->consts()) {
-                        // Use enum node location since consts don't have their own location
-                        startSymbol(c.id, "EnumMember", enm);
-                        endSymbol();
-                    }
-                    endChildren();
-                }
-
+                emitChildren(enm, OUTLINE_ENUM);
                 endSymbol();
                 break;
             }
@@ -299,38 +311,81 @@ public:
 };
 
 
-std::string parseAndExtractSymbols(const std::string& source) {
-    lastError.clear();
+void writeSymbols(std::ostringstream& out, Node* root) {
+    // Symbols are written out during the walk
+    ProfileScope profile(PROFILE_WALK);
+    SymbolExtractor extractor(out);
+    root->visit(&extractor);
+}
 
-    HSQUIRRELVM vm = sq_open(256);
-    if (!vm) {
+
+std::string extractSymbols(DocumentSession& doc) {
+    if (!doc.vm) {
         return "{\"error\":\"Failed to create VM\",\"symbols\":[]}";
     }
 
-    sq_setcompilererrorhandler(vm, compileErrorHandler);
-
-    SqASTData* astData = sq_parsetoast(vm, source.c_str(), source.length(),
-                                        "document", SQFalse, SQFalse);
-
-    if (!astData || !astData->root) {
-        std::string error = lastError.empty() ? "Parse failed" : lastError;
-        sq_close(vm);
+    SqASTData* astData = doc.ast();
 
+    if (!astData) {
         std::ostringstream out;
-        out << "{\"error\":\"" << escapeJson(error.c_str()) << "\",\"symbols\":[]}";
+        out << "{\"error\":\"" << escapeJson(doc.parseError.c_str()) << "\",\"symbols\":[]}";
         return out.str();
     }
 
     std::ostringstream out;
     out << "{\"error\":null,\"symbols\":[";
 
-    SymbolExtractor extractor(out);
-    astData->root->visit(&extractor);
-
+    writeSymbols(out, astData->root);
     out << "]}";
 
-    sq_releaseASTData(vm, astData);
-    sq_close(vm);
+    return out.str();
+}
+
+
+std::string parseAndExtractSymbols(const std::string& source) {
+    DocumentSession doc(source);
+    return extractSymbols(doc);
+}
+
+std::string documentSymbols(int docId) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc) {
+        return "{\"error\":\"Unknown document\",\"symbols\":[]}";
+    }
+    return extractSymbols(*doc);
+}
+
+// Outline levels below parentId (0 for the top level), see engine.h
+std::string documentOutline(int docId, int parentId, int depth) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc) {
+        return "{\"error\":\"Unknown document\",\"symbols\":[]}";
+    }
+    if (parentId <= 0) {
+        if (!doc->vm) {
+            return "{\"error\":\"Failed to create VM\",\"symbols\":[]}";
+        }
+        if (!doc->ast()) {
+            return "{\"error\":\"" + escapeJson(doc->parseError.c_str()) + "\",\"symbols\":[]}";
+        }
+    }
+
+    const DocumentSession::OutlineEntry* parent = parentId > 0 ? doc->outlineEntry(parentId) : nullptr;
+    if (parentId > 0 && !parent) {
+        return "{\"error\":\"Unknown symbol\",\"symbols\":[]}";
+    }
 
+    std::ostringstream out;
+    out << "{\"error\":null,\"symbols\":[";
+    {
+        ProfileScope profile(PROFILE_WALK);
+        SymbolExtractor extractor(out, depth > 0 ? depth : INT_MAX, doc);
+        if (parent) {
+            extractor.writeChildren(parent->owner, parent->source);
+        } else {
+            doc->ast()->root->visit(&extractor);
+        }
+    }
+    out << "]}";
     return out.str();
 }
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <sstream>
+#include "compiler/ast.h"
+
+
+// Write outline symbols of the AST as comma-separated JSON objects
+void writeSymbols(std::ostringstream& out, SQCompilation::Node* root);
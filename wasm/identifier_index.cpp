@@ -0,0 +1,89 @@
+#include "identifier_index.h"
+#include <algorithm>
+#include <string.h>
+#include "scan.h"
+
+
+static bool isIdentStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isIdentChar(char c) {
+    return isIdentStart(c) || (c >= '0' && c <= '9');
+}
+
+
+void IdentifierIndex::build(const std::string& source) {
+    items.clear();
+
+    const char* s = source.data();
+    size_t n = source.size();
+    size_t i = 0;
+
+    while (i < n) {
+        char c = s[i];
+
+        if (isIdentStart(c)) {
+            size_t start = i;
+            i = skipIdentifierChars(s, n, i + 1);
+            items.push_back({(uint32_t)start, (uint32_t)(i - start)});
+            continue;
+        }
+
+        // Numbers, so that suffixes like 0x1F or 1e5 are not taken for names
+        if (c >= '0' && c <= '9') {
+            while (i < n && (isIdentChar(s[i]) || s[i] == '.')) ++i;
+            continue;
+        }
+
+        // Line comments: //, and # (also used for directives)
+        if (c == '#' || (c == '/' && i + 1 < n && s[i + 1] == '/')) {
+            i = findAnyOf(s, n, i, "\n");
+            continue;
+        }
+
+        if (c == '/' && i + 1 < n && s[i + 1] == '*') {
+            size_t end = source.find("*/", i + 2);
+            i = end != std::string::npos ? end + 2 : n;
+            continue;
+        }
+
+        // Verbatim string, "" is an escaped quote
+        if (c == '@' && i + 1 < n && s[i + 1] == '"') {
+            for (i += 2; i < n; ++i) {
+                if (s[i] == '"') {
+                    if (i + 1 < n && s[i + 1] == '"') ++i;
+                    else break;
+                }
+            }
+            ++i;
+            continue;
+        }
+
+        // Regular, interpolated ($"...") and character literals
+        if (c == '"' || c == '\'') {
+            for (++i; i < n && s[i] != c && s[i] != '\n'; ++i) {
+                if (s[i] == '\\') ++i;
+            }
+            ++i;
+            continue;
+        }
+
+        ++i;
+    }
+}
+
+const IdentifierIndex::Token* IdentifierIndex::findAfter(
+    const std::string& source, size_t offset,
+    const char* name, size_t nameLen, int maxTokens) const
+{
+    auto it = std::lower_bound(items.begin(), items.end(), offset,
+        [](const Token& t, size_t off) { return t.offset < off; });
+
+    for (int seen = 0; it != items.end() && seen < maxTokens; ++it, ++seen) {
+        if (it->length == nameLen && memcmp(source.data() + it->offset, name, nameLen) == 0) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// Offsets of identifier tokens (keywords included) in source text, with
+// comments and string literals skipped. Built once per document version so
+// that declaration names can be located from the position the AST reports
+// for the declaration without rescanning source lines.
+class IdentifierIndex {
+public:
+    struct Token {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    void build(const std::string& source);
+
+    // First token spelled `name` among the next maxTokens tokens starting
+    // at or after offset, nullptr if there is none
+    const Token* findAfter(const std::string& source, size_t offset,
+                           const char* name, size_t nameLen, int maxTokens) const;
+
+    const std::vector<Token>& tokens() const { return items; }
+
+private:
+    std::vector<Token> items;
+};
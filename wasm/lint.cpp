@@ -0,0 +1,278 @@
+// Headless linter over the engine, for CI.
+//
+//   cmake -S wasm -B wasm/build-tools -DQUIRREL_NAPI=OFF && cmake --build wasm/build-tools --target quirrel-lint
+//   wasm/build-tools/quirrel-lint [options] <file or directory>...
+//     -j <threads>            Worker threads (default: one per hardware thread)
+//     --format <format>       text (default), json or sarif
+//     --warnings-as-errors    Fail on warnings too
+//
+// Directories are searched for .nut files. Each file is analyzed under the
+// .sqconfig files of its directory and its parents, outermost first, as the
+// extension does. Exits with 1 if errors were reported, 2 on usage errors or
+// unreadable files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.h"
+#include "utils.h"
+
+namespace fs = std::filesystem;
+
+
+static const char* const CONFIG_FILE_NAME = ".sqconfig";
+
+enum OutputFormat { FORMAT_TEXT, FORMAT_JSON, FORMAT_SARIF };
+
+struct LintFile {
+    std::string path;        // As reported, relative to the working directory when below it
+    std::string source;
+    std::string configChain;
+    DiagnosticBuffer messages;
+};
+
+
+static bool readFile(const fs::path& path, std::string& text) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream content;
+    content << in.rdbuf();
+    text = content.str();
+    return true;
+}
+
+static std::string displayPath(const fs::path& path) {
+    std::error_code ec;
+    fs::path relative = fs::relative(path, fs::current_path(ec), ec);
+    if (ec || relative.empty() || *relative.begin() == "..") return path.generic_string();
+    return relative.generic_string();
+}
+
+static bool collectFiles(const std::string& arg, std::vector<fs::path>& files) {
+    std::error_code ec;
+    if (fs::is_directory(arg, ec)) {
+        for (const auto& entry : fs::recursive_directory_iterator(arg, ec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".nut")
+                files.push_back(fs::absolute(entry.path()));
+        }
+        return true;
+    }
+    if (!fs::is_regular_file(arg, ec)) return false;
+    files.push_back(fs::absolute(arg));
+    return true;
+}
+
+// Chain of the configs above dir, each registered once with the engine
+static const std::string& configChain(const fs::path& dir, std::map<fs::path, std::string>& chains) {
+    auto found = chains.find(dir);
+    if (found != chains.end()) return found->second;
+
+    std::string chain = dir.has_parent_path() && dir.parent_path() != dir
+        ? configChain(dir.parent_path(), chains)
+        : std::string();
+
+    fs::path config = dir / CONFIG_FILE_NAME;
+    std::string text;
+    std::error_code ec;
+    if (fs::is_regular_file(config, ec) && readFile(config, text) && setAnalyzerConfig(config.string(), text)) {
+        if (!chain.empty()) chain += '\n';
+        chain += config.string();
+    }
+    return chains[dir] = chain;
+}
+
+
+// Analyzer settings are process-wide, so files are linted one config chain
+// at a time: the chain is applied here, and the workers' own
+// applyAnalyzerConfig calls then find it in place and only read it.
+// Everything else a session touches is per VM or per thread.
+static void lintGroup(std::vector<LintFile>& files, const std::vector<size_t>& group, int threads) {
+    applyAnalyzerConfig(files[group.front()].configChain);
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < group.size(); ) {
+            LintFile& file = files[group[i]];
+            DocumentSession doc(file.source);
+            if (doc.vm) file.messages = collectMessages(doc, file.configChain);
+            file.source = std::string();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    int count = std::max(1, std::min<int>(threads, int(group.size())));
+    for (int t = 1; t < count; ++t) workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers) worker.join();
+}
+
+
+static std::string messageString(const DiagnosticBuffer& messages, size_t i, int which) {
+    const int32_t* s = &messages.strings[i * DiagnosticBuffer::STRINGS_PER_MESSAGE + which * 2];
+    return messages.pool.substr(s[0], s[1]);
+}
+
+static std::string ruleId(const DiagnosticBuffer& messages, size_t i) {
+    if (messages.intId[i] < 0) return "parse-error";
+    std::string textId = messageString(messages, i, 1);
+    return textId.empty() ? "w" + std::to_string(messages.intId[i]) : textId;
+}
+
+static void writeText(const std::vector<LintFile>& files) {
+    for (const LintFile& file : files) {
+        const DiagnosticBuffer& m = file.messages;
+        for (size_t i = 0; i < m.size(); ++i) {
+            printf("%s:%d:%d: %s: %s [%s]\n", file.path.c_str(), m.line[i], m.col[i] + 1,
+                m.isError[i] ? "error" : "warning", messageString(m, i, 0).c_str(), ruleId(m, i).c_str());
+        }
+    }
+}
+
+static void writeJson(const std::vector<LintFile>& files, size_t errors, size_t warnings) {
+    std::ostringstream out;
+    out << "{\"files\":" << files.size() << ",\"errors\":" << errors << ",\"warnings\":" << warnings
+        << ",\"diagnostics\":[";
+    bool first = true;
+    for (const LintFile& file : files) {
+        const DiagnosticBuffer& m = file.messages;
+        for (size_t i = 0; i < m.size(); ++i) {
+            if (!first) out << ",";
+            first = false;
+            out << "{\"file\":\"" << escapeJson(file.path.c_str()) << "\""
+                << ",\"line\":" << m.line[i]
+                << ",\"col\":" << m.col[i]
+                << ",\"len\":" << m.len[i]
+                << ",\"intId\":" << m.intId[i]
+                << ",\"textId\":\"" << escapeJson(messageString(m, i, 1).c_str()) << "\""
+                << ",\"message\":\"" << escapeJson(messageString(m, i, 0).c_str()) << "\""
+                << ",\"isError\":" << (m.isError[i] ? "true" : "false")
+                << "}";
+        }
+    }
+    out << "]}\n";
+    fputs(out.str().c_str(), stdout);
+}
+
+// SARIF 2.1.0, columns 1-based
+static void writeSarif(const std::vector<LintFile>& files) {
+    std::ostringstream results;
+    std::map<std::string, bool> rules;
+    bool first = true;
+    for (const LintFile& file : files) {
+        const DiagnosticBuffer& m = file.messages;
+        for (size_t i = 0; i < m.size(); ++i) {
+            std::string rule = ruleId(m, i);
+            rules[rule] = true;
+            if (!first) results << ",";
+            first = false;
+            results << "{\"ruleId\":\"" << escapeJson(rule.c_str()) << "\""
+                << ",\"level\":\"" << (m.isError[i] ? "error" : "warning") << "\""
+                << ",\"message\":{\"text\":\"" << escapeJson(messageString(m, i, 0).c_str()) << "\"}"
+                << ",\"locations\":[{\"physicalLocation\":{"
+                << "\"artifactLocation\":{\"uri\":\"" << escapeJson(file.path.c_str()) << "\"}"
+                << ",\"region\":{\"startLine\":" << m.line[i]
+                << ",\"startColumn\":" << m.col[i] + 1
+                << ",\"endColumn\":" << m.col[i] + 1 + std::max(0, int(m.len[i]))
+                << "}}}]}";
+        }
+    }
+
+    std::ostringstream out;
+    out << "{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\""
+        << ",\"runs\":[{\"tool\":{\"driver\":{\"name\":\"quirrel-lint\",\"rules\":[";
+    first = true;
+    for (const auto& rule : rules) {
+        if (!first) out << ",";
+        first = false;
+        out << "{\"id\":\"" << escapeJson(rule.first.c_str()) << "\"}";
+    }
+    out << "]}},\"results\":[" << results.str() << "]}]}\n";
+    fputs(out.str().c_str(), stdout);
+}
+
+
+static int usage() {
+    fprintf(stderr, "Usage: quirrel-lint [-j threads] [--format text|json|sarif] [--warnings-as-errors] "
+        "<file or directory>...\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    int threads = std::max(1, int(std::thread::hardware_concurrency()));
+    OutputFormat format = FORMAT_TEXT;
+    bool warningsAsErrors = false;
+    std::vector<fs::path> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "text") == 0) format = FORMAT_TEXT;
+            else if (strcmp(name, "json") == 0) format = FORMAT_JSON;
+            else if (strcmp(name, "sarif") == 0) format = FORMAT_SARIF;
+            else return usage();
+        } else if (strcmp(argv[i], "--warnings-as-errors") == 0) {
+            warningsAsErrors = true;
+        } else if (argv[i][0] == '-') {
+            return usage();
+        } else if (!collectFiles(argv[i], paths)) {
+            fprintf(stderr, "Cannot read %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (paths.empty()) return usage();
+
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+    std::vector<LintFile> files(paths.size());
+    std::map<fs::path, std::string> chains;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        files[i].path = displayPath(paths[i]);
+        files[i].configChain = configChain(paths[i].parent_path(), chains);
+        if (!readFile(paths[i], files[i].source)) {
+            fprintf(stderr, "Cannot read %s\n", files[i].path.c_str());
+            clearAnalyzerConfigs();
+            return 2;
+        }
+    }
+
+    // Largest files first, so that no thread is left with a big one at the end
+    std::map<std::string, std::vector<size_t>> groups;
+    for (size_t i = 0; i < files.size(); ++i) groups[files[i].configChain].push_back(i);
+    for (auto& group : groups) {
+        std::stable_sort(group.second.begin(), group.second.end(), [&](size_t a, size_t b) {
+            return files[a].source.size() > files[b].source.size();
+        });
+        lintGroup(files, group.second, threads);
+    }
+    clearAnalyzerConfigs();
+
+    size_t errors = 0, warnings = 0;
+    for (const LintFile& file : files) {
+        for (size_t i = 0; i < file.messages.size(); ++i) {
+            if (file.messages.isError[i]) ++errors;
+            else ++warnings;
+        }
+    }
+
+    switch (format) {
+        case FORMAT_TEXT: writeText(files); break;
+        case FORMAT_JSON: writeJson(files, errors, warnings); break;
+        case FORMAT_SARIF: writeSarif(files); break;
+    }
+    if (format == FORMAT_TEXT) {
+        fprintf(stderr, "%zu files, %zu errors, %zu warnings\n", files.size(), errors, warnings);
+    }
+    return errors > 0 || (warningsAsErrors && warnings > 0) ? 1 : 0;
+}
@@ -0,0 +1,330 @@
+// Node-API layer over the engine API, the native counterpart of native.cpp.
+// Built as out/native/<platform>-<arch>/quirrel-native.node with
+// scripts/build-native.mjs; the engine worker prefers it over the WASM
+// module when it is present.
+
+#include <node_api.h>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <string.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "engine.h"
+#include "cancel.h"
+
+
+// Missing or mistyped arguments read as 0, false and "", as embind would convert them
+
+template<typename T> static T fromJs(napi_env env, napi_value v);
+
+template<> int fromJs<int>(napi_env env, napi_value v) {
+    int32_t result = 0;
+    napi_get_value_int32(env, v, &result);
+    return result;
+}
+
+template<> bool fromJs<bool>(napi_env env, napi_value v) {
+    bool result = false;
+    napi_get_value_bool(env, v, &result);
+    return result;
+}
+
+template<> std::string fromJs<std::string>(napi_env env, napi_value v) {
+    size_t length = 0;
+    if (napi_get_value_string_utf8(env, v, nullptr, 0, &length) != napi_ok) return std::string();
+    std::string result(length, '\0');
+    napi_get_value_string_utf8(env, v, &result[0], length + 1, &length);
+    return result;
+}
+
+static napi_value toJs(napi_env env, const std::string& s) {
+    napi_value result;
+    napi_create_string_utf8(env, s.data(), s.size(), &result);
+    return result;
+}
+
+static napi_value toJs(napi_env env, bool b) {
+    napi_value result;
+    napi_get_boolean(env, b, &result);
+    return result;
+}
+
+
+template<typename F> struct Signature;
+template<typename R, typename... A> struct Signature<R (*)(A...)> {
+    using Result = R;
+    using Args = std::tuple<std::decay_t<A>...>;
+    static const size_t arity = sizeof...(A);
+};
+
+template<auto Fn, size_t... I>
+static napi_value invoke(napi_env env, napi_value* argv, std::index_sequence<I...>) {
+    using Sig = Signature<decltype(Fn)>;
+    if constexpr (std::is_void_v<typename Sig::Result>) {
+        Fn(fromJs<std::tuple_element_t<I, typename Sig::Args>>(env, argv[I])...);
+        napi_value undefined;
+        napi_get_undefined(env, &undefined);
+        return undefined;
+    } else {
+        return toJs(env, Fn(fromJs<std::tuple_element_t<I, typename Sig::Args>>(env, argv[I])...));
+    }
+}
+
+template<auto Fn>
+static napi_value bound(napi_env env, napi_callback_info info) {
+    using Sig = Signature<decltype(Fn)>;
+    napi_value argv[Sig::arity > 0 ? Sig::arity : 1];
+    size_t argc = Sig::arity;
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+    for (size_t i = argc; i < Sig::arity; ++i) {
+        napi_get_undefined(env, &argv[i]);
+    }
+
+    try {
+        return invoke<Fn>(env, argv, std::make_index_sequence<Sig::arity>());
+    } catch (const std::exception& e) {
+        napi_throw_error(env, nullptr, e.what());
+        return nullptr;
+    }
+}
+
+
+// Typed arrays over copies of engine buffers. Unlike the WASM views they
+// own their memory, so they stay valid after the next engine call.
+template<typename T>
+static napi_value copyArray(napi_env env, napi_typedarray_type type, const T* data, size_t count) {
+    void* bytes = nullptr;
+    napi_value buffer, array;
+    napi_create_arraybuffer(env, count * sizeof(T), &bytes, &buffer);
+    if (count > 0) memcpy(bytes, data, count * sizeof(T));
+    napi_create_typedarray(env, type, count, buffer, 0, &array);
+    return array;
+}
+
+static napi_value int32Array(napi_env env, const std::vector<int32_t>& v) {
+    return copyArray(env, napi_int32_array, v.data(), v.size());
+}
+
+static void setField(napi_env env, napi_value object, const char* name, napi_value value) {
+    napi_set_named_property(env, object, name, value);
+}
+
+static napi_value nullValue(napi_env env) {
+    napi_value result;
+    napi_get_null(env, &result);
+    return result;
+}
+
+// Same shape as packedTokensView in native.cpp
+static napi_value packedTokens(napi_env env, const PackedSemanticTokens* packed) {
+    if (!packed) return nullValue(env);
+
+    napi_value result;
+    napi_create_object(env, &result);
+    setField(env, result, "data", int32Array(env, packed->data));
+    setField(env, result, "nameIds", int32Array(env, packed->nameIds));
+    setField(env, result, "nameHashes", int32Array(env, packed->nameHashes));
+    return result;
+}
+
+static napi_value documentAnalyzeBinary(napi_env env, int docId, const std::string& configChain) {
+    const DiagnosticBuffer* diags = documentAnalyzePacked(docId, configChain);
+    if (!diags) return nullValue(env);
+
+    napi_value result;
+    napi_create_object(env, &result);
+    setField(env, result, "line", int32Array(env, diags->line));
+    setField(env, result, "col", int32Array(env, diags->col));
+    setField(env, result, "len", int32Array(env, diags->len));
+    setField(env, result, "intId", int32Array(env, diags->intId));
+    setField(env, result, "isError", int32Array(env, diags->isError));
+    setField(env, result, "strings", int32Array(env, diags->strings));
+    setField(env, result, "pool", copyArray(env, napi_uint8_array,
+        reinterpret_cast<const uint8_t*>(diags->pool.data()), diags->pool.size()));
+    return result;
+}
+
+// Binary results need the env to build their arrays
+static napi_value analyzeBinaryBinding(napi_env env, napi_callback_info info) {
+    napi_value argv[2];
+    size_t argc = 2;
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+    int docId = argc > 0 ? fromJs<int>(env, argv[0]) : 0;
+    std::string configChain = argc > 1 ? fromJs<std::string>(env, argv[1]) : std::string();
+    return documentAnalyzeBinary(env, docId, configChain);
+}
+
+static napi_value tokensBinaryBinding(napi_env env, napi_callback_info info) {
+    napi_value argv[1];
+    size_t argc = 1;
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+    int docId = argc > 0 ? fromJs<int>(env, argv[0]) : 0;
+    return packedTokens(env, documentSemanticTokensPacked(docId, 1, 0));
+}
+
+static napi_value tokensRangeBinaryBinding(napi_env env, napi_callback_info info) {
+    napi_value argv[3];
+    size_t argc = 3;
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+    int args[3] = {0, 0, 0};
+    for (size_t i = 0; i < argc && i < 3; ++i) {
+        args[i] = fromJs<int>(env, argv[i]);
+    }
+    return packedTokens(env, documentSemanticTokensPacked(args[0], args[1], args[2]));
+}
+
+static napi_value intValue(napi_env env, int value) {
+    napi_value result;
+    napi_create_int32(env, value, &result);
+    return result;
+}
+
+static napi_value tokensDeltaBinding(napi_env env, napi_callback_info info) {
+    napi_value argv[2];
+    size_t argc = 2;
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+    int docId = argc > 0 ? fromJs<int>(env, argv[0]) : 0;
+    int previousResultId = argc > 1 ? fromJs<int>(env, argv[1]) : 0;
+
+    const SemanticTokensDelta* delta = documentSemanticTokensDelta(docId, previousResultId);
+    if (!delta) return nullValue(env);
+
+    napi_value result;
+    napi_create_object(env, &result);
+    setField(env, result, "resultId", intValue(env, delta->resultId));
+    setField(env, result, "full", toJs(env, delta->full));
+    setField(env, result, "start", intValue(env, delta->start));
+    setField(env, result, "deleteCount", intValue(env, delta->deleteCount));
+    setField(env, result, "data", copyArray(env, napi_int32_array, delta->data, delta->size));
+    return result;
+}
+
+// Batch input is a Uint8Array or Buffer (or a string)
+static napi_value batchBinding(napi_env env, napi_callback_info info) {
+    napi_value argv[2];
+    size_t argc = 2;
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    std::string input;
+    bool isTypedArray = false;
+    if (argc > 0 && napi_is_typedarray(env, argv[0], &isTypedArray) == napi_ok && isTypedArray) {
+        napi_typedarray_type type;
+        size_t length = 0;
+        void* data = nullptr;
+        napi_get_typedarray_info(env, argv[0], &type, &length, &data, nullptr, nullptr);
+        if (type == napi_uint8_array || type == napi_int8_array || type == napi_uint8_clamped_array) {
+            input.assign(static_cast<const char*>(data), length);
+        }
+    } else if (argc > 0) {
+        input = fromJs<std::string>(env, argv[0]);
+    }
+    int operation = argc > 1 ? fromJs<int>(env, argv[1]) : 0;
+
+    const std::string* result = processBatch(input, operation);
+    if (!result) return nullValue(env);
+
+    napi_value view;
+    napi_create_object(env, &view);
+    setField(env, view, "data", copyArray(env, napi_uint8_array,
+        reinterpret_cast<const uint8_t*>(result->data()), result->size()));
+    return view;
+}
+
+// Int32Array over the host's SharedArrayBuffer, see cancel.h. The reference
+// keeps the memory alive while the engine reads it.
+static napi_ref cancelFlagsRef = nullptr;
+
+static napi_value cancelFlagsBinding(napi_env env, napi_callback_info info) {
+    napi_value argv[1];
+    size_t argc = 1;
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    setCancelFlags(nullptr, 0);
+    if (cancelFlagsRef) {
+        napi_delete_reference(env, cancelFlagsRef);
+        cancelFlagsRef = nullptr;
+    }
+
+    bool isTypedArray = false;
+    if (argc > 0 && napi_is_typedarray(env, argv[0], &isTypedArray) == napi_ok && isTypedArray) {
+        napi_typedarray_type type;
+        size_t length = 0;
+        void* data = nullptr;
+        napi_get_typedarray_info(env, argv[0], &type, &length, &data, nullptr, nullptr);
+        if (type == napi_int32_array && napi_create_reference(env, argv[0], 1, &cancelFlagsRef) == napi_ok) {
+            setCancelFlags(static_cast<const int32_t*>(data), length);
+        }
+    }
+
+    napi_value undefined;
+    napi_get_undefined(env, &undefined);
+    return undefined;
+}
+
+
+// The engine keeps process-wide state (open documents, analyzer configs,
+// profiling counters), while every worker thread loading the addon gets its
+// own env. Only one env at a time may use it; the others fail to load and
+// fall back to WASM. The state is dropped when the owning worker goes away.
+static std::atomic<bool> claimed(false);
+
+static void releaseEngine(void*) {
+    closeAllDocumentSessions();
+    clearAnalyzerConfigs();
+    setProfilingEnabled(false);
+    setMemoryBudget(0);
+    // The reference goes with the env
+    setCancelFlags(nullptr, 0);
+    cancelFlagsRef = nullptr;
+    claimed = false;
+}
+
+static void exportFunction(napi_env env, napi_value exports, const char* name, napi_callback cb) {
+    napi_value fn;
+    napi_create_function(env, name, NAPI_AUTO_LENGTH, cb, nullptr, &fn);
+    napi_set_named_property(env, exports, name, fn);
+}
+
+NAPI_MODULE_INIT() {
+    if (claimed.exchange(true)) {
+        napi_throw_error(env, nullptr, "Engine addon is in use by another thread");
+        return nullptr;
+    }
+    napi_add_env_cleanup_hook(env, releaseEngine, nullptr);
+
+    exportFunction(env, exports, "parseAndExtractSymbols", bound<&parseAndExtractSymbols>);
+    exportFunction(env, exports, "analyzeCode", bound<&analyzeCode>);
+    exportFunction(env, exports, "findDeclarationAt", bound<&findDeclarationAt>);
+    exportFunction(env, exports, "extractSemanticTokens", bound<&extractSemanticTokens>);
+    exportFunction(env, exports, "extractSemanticTokensRange", bound<&extractSemanticTokensRange>);
+
+    exportFunction(env, exports, "openDocument", bound<&openDocument>);
+    exportFunction(env, exports, "updateDocument", bound<&updateDocument>);
+    exportFunction(env, exports, "editDocument", bound<&editDocument>);
+    exportFunction(env, exports, "closeDocument", bound<&closeDocument>);
+    exportFunction(env, exports, "setMemoryBudget", bound<&setMemoryBudget>);
+    exportFunction(env, exports, "setDocumentPinned", bound<&setDocumentPinned>);
+    exportFunction(env, exports, "memoryStats", bound<&memoryStats>);
+    exportFunction(env, exports, "setProfilingEnabled", bound<&setProfilingEnabled>);
+    exportFunction(env, exports, "takeProfile", bound<&takeProfile>);
+    exportFunction(env, exports, "setAnalyzerConfig", bound<&setAnalyzerConfig>);
+    exportFunction(env, exports, "removeAnalyzerConfig", bound<&removeAnalyzerConfig>);
+    exportFunction(env, exports, "documentSymbols", bound<&documentSymbols>);
+    exportFunction(env, exports, "documentOutline", bound<&documentOutline>);
+    exportFunction(env, exports, "documentAnalyze", bound<&documentAnalyze>);
+    exportFunction(env, exports, "documentAnalyzeAll", bound<&documentAnalyzeAll>);
+    exportFunction(env, exports, "documentAnalyzeBinary", analyzeBinaryBinding);
+    exportFunction(env, exports, "documentFindDeclarationAt", bound<&documentFindDeclarationAt>);
+    exportFunction(env, exports, "documentFindReferences", bound<&documentFindReferences>);
+    exportFunction(env, exports, "documentSemanticTokens", bound<&documentSemanticTokens>);
+    exportFunction(env, exports, "documentSemanticTokensBinary", tokensBinaryBinding);
+    exportFunction(env, exports, "documentSemanticTokensRangeBinary", tokensRangeBinaryBinding);
+    exportFunction(env, exports, "documentSemanticTokensDelta", tokensDeltaBinding);
+    exportFunction(env, exports, "processBatch", batchBinding);
+    exportFunction(env, exports, "setCancelFlags", cancelFlagsBinding);
+    exportFunction(env, exports, "takeCallCancelled", bound<&takeCallCancelled>);
+    return exports;
+}
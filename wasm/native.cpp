@@ -1,11 +1,77 @@
 #include <string>
 #include <emscripten/bind.h>
+#include "engine.h"
+#include "cancel.h"
 
 
-std::string parseAndExtractSymbols(const std::string& source);
-std::string analyzeCode(const std::string& source);
-std::string findDeclarationAt(const std::string& source, int line, int col);
-std::string extractSemanticTokens(const std::string& source);
+// embind layer over the engine API, see napi.cpp for the Node addon
+
+template<typename T>
+static emscripten::val view(const std::vector<T>& v) {
+    return emscripten::val(emscripten::typed_memory_view(v.size(), v.data()));
+}
+
+// Typed array views into the session's token buffers.
+// They stay valid until the next call for this document or until the WASM
+// heap grows, so JS has to copy them out right away.
+static emscripten::val packedTokensView(const PackedSemanticTokens* packed) {
+    if (!packed) return emscripten::val::null();
+
+    emscripten::val result = emscripten::val::object();
+    result.set("data", view(packed->data));
+    result.set("nameIds", view(packed->nameIds));
+    result.set("nameHashes", view(packed->nameHashes));
+    return result;
+}
+
+// Diagnostics as parallel Int32Arrays plus the UTF-8 string pool, same lifetime rules
+emscripten::val documentAnalyzeBinary(int docId, const std::string& configChain) {
+    const DiagnosticBuffer* diags = documentAnalyzePacked(docId, configChain);
+    if (!diags) return emscripten::val::null();
+
+    emscripten::val result = emscripten::val::object();
+    result.set("line", view(diags->line));
+    result.set("col", view(diags->col));
+    result.set("len", view(diags->len));
+    result.set("intId", view(diags->intId));
+    result.set("isError", view(diags->isError));
+    result.set("strings", view(diags->strings));
+    result.set("pool", emscripten::val(emscripten::typed_memory_view(
+        diags->pool.size(), reinterpret_cast<const uint8_t*>(diags->pool.data()))));
+    return result;
+}
+
+emscripten::val documentSemanticTokensDeltaBinary(int docId, int previousResultId) {
+    const SemanticTokensDelta* delta = documentSemanticTokensDelta(docId, previousResultId);
+    if (!delta) return emscripten::val::null();
+
+    emscripten::val result = emscripten::val::object();
+    result.set("resultId", delta->resultId);
+    result.set("full", delta->full);
+    result.set("start", delta->start);
+    result.set("deleteCount", delta->deleteCount);
+    result.set("data", emscripten::val(emscripten::typed_memory_view(delta->size, delta->data)));
+    return result;
+}
+
+// Batch input may come as a Uint8Array, the result is a view of the batch buffer
+emscripten::val processBatchBinary(const std::string& input, int operation) {
+    const std::string* result = processBatch(input, operation);
+    if (!result) return emscripten::val::null();
+
+    emscripten::val view = emscripten::val::object();
+    view.set("data", emscripten::val(emscripten::typed_memory_view(
+        result->size(), reinterpret_cast<const uint8_t*>(result->data()))));
+    return view;
+}
+
+emscripten::val documentSemanticTokensBinary(int docId) {
+    return packedTokensView(documentSemanticTokensPacked(docId, 1, 0));
+}
+
+emscripten::val documentSemanticTokensRangeBinary(int docId, int firstLine, int lastLine) {
+    return packedTokensView(documentSemanticTokensPacked(docId, firstLine, lastLine));
+}
 
 
 EMSCRIPTEN_BINDINGS(quirrel_vscode) {
@@ -13,4 +79,30 @@ EMSCRIPTEN_BINDINGS(quirrel_vscode) {
     emscripten::function("analyzeCode", &analyzeCode);
     emscripten::function("findDeclarationAt", &findDeclarationAt);
     emscripten::function("extractSemanticTokens", &extractSemanticTokens);
+    emscripten::function("extractSemanticTokensRange", &extractSemanticTokensRange);
+
+    emscripten::function("openDocument", &openDocument);
+    emscripten::function("updateDocument", &updateDocument);
+    emscripten::function("editDocument", &editDocument);
+    emscripten::function("closeDocument", &closeDocument);
+    emscripten::function("setMemoryBudget", &setMemoryBudget);
+    emscripten::function("setDocumentPinned", &setDocumentPinned);
+    emscripten::function("memoryStats", &memoryStats);
+    emscripten::function("setProfilingEnabled", &setProfilingEnabled);
+    emscripten::function("takeProfile", &takeProfile);
+    emscripten::function("takeCallCancelled", &takeCallCancelled);
+    emscripten::function("setAnalyzerConfig", &setAnalyzerConfig);
+    emscripten::function("removeAnalyzerConfig", &removeAnalyzerConfig);
+    emscripten::function("documentSymbols", &documentSymbols);
+    emscripten::function("documentOutline", &documentOutline);
+    emscripten::function("documentAnalyze", &documentAnalyze);
+    emscripten::function("documentAnalyzeAll", &documentAnalyzeAll);
+    emscripten::function("documentAnalyzeBinary", &documentAnalyzeBinary);
+    emscripten::function("documentFindDeclarationAt", &documentFindDeclarationAt);
+    emscripten::function("documentFindReferences", &documentFindReferences);
+    emscripten::function("documentSemanticTokens", &documentSemanticTokens);
+    emscripten::function("documentSemanticTokensBinary", &documentSemanticTokensBinary);
+    emscripten::function("documentSemanticTokensRangeBinary", &documentSemanticTokensRangeBinary);
+    emscripten::function("documentSemanticTokensDelta", &documentSemanticTokensDeltaBinary);
+    emscripten::function("processBatch", &processBatchBinary);
 }
@@ -0,0 +1,82 @@
+#include "profile.h"
+#include <sstream>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#include <emscripten/heap.h>
+#include <malloc.h>
+#else
+#include <chrono>
+#endif
+
+
+static bool enabled = false;
+static double phaseMs[PROFILE_PHASE_COUNT];
+static size_t heapPeak = 0;
+
+static const char* const PHASE_NAMES[PROFILE_PHASE_COUNT] = {
+    "parse", "walk", "sort", "serialize", "analyze"
+};
+
+
+static double nowMs() {
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now();
+#else
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+size_t heapInUse() {
+#ifdef __EMSCRIPTEN__
+    return size_t(mallinfo().uordblks);
+#else
+    return 0;
+#endif
+}
+
+size_t heapSize() {
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_heap_size();
+#else
+    return 0;
+#endif
+}
+
+
+void setProfilingEnabled(bool enable) {
+    enabled = enable;
+    takeProfile();
+}
+
+bool profilingEnabled() {
+    return enabled;
+}
+
+ProfileScope::ProfileScope(ProfilePhase phase_)
+    : phase(phase_), start(enabled ? nowMs() : -1.0)
+{
+}
+
+ProfileScope::~ProfileScope() {
+    if (start < 0) return;
+    phaseMs[phase] += nowMs() - start;
+    // Sampled when phases end, which is where their buffers peak
+    size_t inUse = heapInUse();
+    if (inUse > heapPeak) heapPeak = inUse;
+}
+
+std::string takeProfile() {
+    size_t inUse = heapInUse();
+    std::ostringstream out;
+    out << "{";
+    for (int i = 0; i < PROFILE_PHASE_COUNT; ++i) {
+        out << "\"" << PHASE_NAMES[i] << "\":" << phaseMs[i] << ",";
+        phaseMs[i] = 0;
+    }
+    out << "\"heapPeak\":" << (heapPeak > inUse ? heapPeak : inUse)
+        << ",\"heapInUse\":" << inUse << "}";
+    heapPeak = 0;
+    return out.str();
+}
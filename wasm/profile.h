@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Opt-in breakdown of where an engine call spends its time. Phases nest
+// freely; each scope adds its own duration, so nested phases of a different
+// kind are counted in both. Scopes cost one branch while profiling is off.
+enum ProfilePhase {
+    PROFILE_PARSE,      // sq_parsetoast
+    PROFILE_WALK,       // AST visitor walks
+    PROFILE_SORT,       // Sorting tokens and declarations
+    PROFILE_SERIALIZE,  // JSON and packed output
+    PROFILE_ANALYZE,    // sq_analyzeast
+    PROFILE_PHASE_COUNT
+};
+
+void setProfilingEnabled(bool enabled);
+bool profilingEnabled();
+
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfilePhase phase);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfilePhase phase;
+    double start;  // Negative while profiling is off
+};
+
+// Phase times in ms and heap use in bytes since the last call, as
+// {"parse":..,"walk":..,"sort":..,"serialize":..,"analyze":..,"heapPeak":..,"heapInUse":..}.
+// Resets the counters.
+std::string takeProfile();
+
+// Bytes handed out by malloc right now and the size of the heap they come
+// from, 0 where it can't be told. Walks the heap, not for hot paths.
+size_t heapInUse();
+size_t heapSize();
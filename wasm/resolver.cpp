@@ -0,0 +1,553 @@
+#include "resolver.h"
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+
+
+using namespace SQCompilation;
+
+
+static const char* getClassName(ClassExpr* cls) {
+    if (cls->classKey() && cls->classKey()->op() == TO_ID) {
+        return static_cast<Id*>(cls->classKey())->name();
+    }
+    return nullptr;
+}
+
+
+// Declaration names are at most a few tokens after the declaration start
+// (`global enum Name`, `foreach (key, value in`), don't look further
+static const int MAX_NAME_LOOKAHEAD = 8;
+
+bool locateName(const std::string& source, const std::vector<size_t>& lineOffsets,
+                const IdentifierIndex& identifiers, const NameSite& site,
+                const char* name, size_t nameLen, int& line, int& col) {
+    if (site.kind == NameSite::AT) {
+        line = site.line;
+        col = site.col;
+        return true;
+    }
+    if (site.line < 1 || site.line > (int)lineOffsets.size()) return false;
+    size_t offset = lineOffsets[site.line - 1] + site.col;
+
+    if (site.kind == NameSite::AFTER_AS) {
+        // Skip the module path, the alias follows "as"
+        const IdentifierIndex::Token* as =
+            identifiers.findAfter(source, offset, "as", 2, MAX_NAME_LOOKAHEAD);
+        if (!as) return false;
+        offset = as->offset + as->length;
+    }
+
+    const IdentifierIndex::Token* tok =
+        identifiers.findAfter(source, offset, name, nameLen, MAX_NAME_LOOKAHEAD);
+    if (!tok) return false;
+    if (site.limitLine >= 1 && site.limitLine <= (int)lineOffsets.size() &&
+        tok->offset >= lineOffsets[site.limitLine - 1] + site.limitCol) return false;
+
+    auto next = std::upper_bound(lineOffsets.begin(), lineOffsets.end(), (size_t)tok->offset);
+    line = (int)(next - lineOffsets.begin());
+    col = (int)(tok->offset - *(next - 1));
+    return true;
+}
+
+
+// Name after line:col that ends before limit starts, if there is a limit
+static NameSite nameBefore(NameSite::Kind kind, int line, int col, Node* limit) {
+    NameSite site = {kind, line, col};
+    if (limit) {
+        site.limitLine = limit->lineStart();
+        site.limitCol = limit->columnStart();
+    }
+    return site;
+}
+
+
+// Module path of a `require("path")` call, nullptr for any other expression
+static const char* requiredModule(Expr* expr) {
+    if (!expr || expr->op() != TO_CALL) return nullptr;
+    CallExpr* call = static_cast<CallExpr*>(expr);
+    Expr* callee = call->callee();
+    if (!callee || callee->op() != TO_ID || strcmp(static_cast<Id*>(callee)->name(), "require") != 0) return nullptr;
+    if (call->arguments().empty() || call->arguments()[0]->op() != TO_LITERAL) return nullptr;
+    LiteralExpr* path = static_cast<LiteralExpr*>(call->arguments()[0]);
+    return path->kind() == LK_STRING ? path->s() : nullptr;
+}
+
+
+ScopeResolver::ScopeResolver() : stopped(false), cancelled(false), firstLine(1), lastLine(INT_MAX) {}
+
+void ScopeResolver::declareSymbol(const char* name, Node* node, const char* kind,
+                                  bool isReadonly, const NameSite& site, const char* module) {
+    if (!name || !*name) return;
+
+    const ResolvedSymbol& sym = symbols.declare({name, node, kind, isReadonly, module});
+    for (ResolveListener* l : listeners) {
+        l->onDeclaration(sym, site);
+    }
+}
+
+// Innermost visible declaration of name
+const ResolvedSymbol* ScopeResolver::findSymbol(const char* name) const {
+    return symbols.lookup(name);
+}
+
+void ScopeResolver::pushScope() {
+    symbols.pushScope();
+}
+
+void ScopeResolver::popScope() {
+    symbols.popScope();
+}
+
+void ScopeResolver::visitFunction(FunctionExpr* fn) {
+    const char* name = fn->name();
+
+    // Declare function in current scope (before entering its scope)
+    if (name && *name) {
+        // Not into the parameters or the body, `function f(f)` or a recursive call
+        Node* limit = fn->parameters().empty() ? static_cast<Node*>(fn->body()) : fn->parameters()[0];
+        declareSymbol(name, fn, "function", false,
+                      nameBefore(NameSite::AFTER, fn->lineStart(), fn->columnStart(), limit));
+    }
+
+    // Parameters and locals are not visible anywhere else
+    if (outsideRange(fn)) return;
+
+    pushScope();
+
+    // Add parameters - ParamDecl position is at the param name
+    for (ParamDecl* param : fn->parameters()) {
+        if (DestructuringDecl* destruct = param->getDestructuring()) {
+            // Destructured params have synthetic names like @arg1,
+            // declare the actual bindings inside
+            for (VarDecl* decl : destruct->declarations()) {
+                declareSymbol(decl->name(), decl, "parameter", !decl->isAssignable(),
+                              {NameSite::AFTER, decl->lineStart(), decl->columnStart()});
+            }
+            continue;
+        }
+
+        declareSymbol(param->name(), param, "parameter", false,
+                      {NameSite::AT, param->lineStart(), param->columnStart()});
+    }
+
+    if (fn->body()) {
+        fn->body()->visit(this);
+    }
+
+    popScope();
+}
+
+void ScopeResolver::visitImport(ImportStmt* import) {
+    if (import->slots.empty()) {
+        // Whole module: import "module" as alias
+        // Search for the alias after "as" keyword to avoid matching in module path
+        if (import->moduleAlias) {
+            declareSymbol(import->moduleAlias, import, "import", true,
+                          {NameSite::AFTER_AS, import->lineStart(), import->columnStart()});
+        }
+        return;
+    }
+
+    // Selective: from "module" import name, name as alias, ...
+    for (const SQModuleImportSlot& slot : import->slots) {
+        if (strcmp(slot.name, "*") == 0) continue;  // Skip wildcard
+
+        if (slot.alias) {
+            // The alias comes after "name as alias", so search after slot position
+            declareSymbol(slot.alias, import, "import", true,
+                          {NameSite::AFTER, slot.line, slot.column + (int)strlen(slot.name)});
+        } else {
+            // Slot line/column point to the imported name
+            declareSymbol(slot.name, import, "import", true,
+                          {NameSite::AT, slot.line, slot.column});
+        }
+    }
+}
+
+void ScopeResolver::visitNode(Node* node) {
+    if (stopped) return;
+    if (cancelPoll()) {
+        cancelled = true;
+        stop();
+        return;
+    }
+
+    TreeOp op = node->op();
+
+    switch (op) {
+        case TO_BLOCK: {
+            Block* block = static_cast<Block*>(node);
+            // Only create new scope for non-root blocks
+            bool needsScope = !block->isRoot();
+            if (needsScope && outsideRange(block)) break;
+            if (needsScope) pushScope();
+
+            for (Statement* stmt : block->statements()) {
+                if (stopped) break;
+                if (stmt->lineStart() > lastLine) {
+                    stop();  // Nothing after this can affect the range
+                    break;
+                }
+                stmt->visit(this);
+            }
+
+            if (needsScope) popScope();
+            break;
+        }
+
+        case TO_FUNCTION:
+            visitFunction(static_cast<FunctionExpr*>(node));
+            break;
+
+        case TO_CLASS: {
+            ClassExpr* cls = static_cast<ClassExpr*>(node);
+            const char* name = getClassName(cls);
+
+            if (name) {
+                Id* classKey = static_cast<Id*>(cls->classKey());
+                declareSymbol(name, cls, "class", false,
+                              {NameSite::AT, classKey->lineStart(), classKey->columnStart()});
+            }
+
+            // Visit class base if present (might reference identifiers)
+            if (cls->classBase()) {
+                cls->classBase()->visit(this);
+            }
+
+            // Visit members (methods might have bodies with identifiers)
+            for (const auto& member : cls->members()) {
+                if (stopped) break;
+                if (member.value) {
+                    member.value->visit(this);
+                }
+            }
+            break;
+        }
+
+        case TO_ENUM: {
+            EnumDecl* enm = static_cast<EnumDecl*>(node);
+            declareSymbol(enm->name(), enm, "enum", false,
+                          {NameSite::AFTER, enm->lineStart(), enm->columnStart()});
+            // Enum members are accessed as EnumName.Member, handled in GETFIELD
+            break;
+        }
+
+        case TO_VAR: {
+            VarDecl* var = static_cast<VarDecl*>(node);
+            bool readonly = !var->isAssignable();
+
+            // Visit initializer first (before declaring, for cases like `let x = x + 1`)
+            if (var->initializer()) {
+                var->initializer()->visit(this);
+            }
+
+            declareSymbol(var->name(), var, readonly ? "binding" : "variable", readonly,
+                          nameBefore(NameSite::AFTER, var->lineStart(), var->columnStart(), var->initializer()));
+            break;
+        }
+
+        case TO_CONST: {
+            ConstDecl* con = static_cast<ConstDecl*>(node);
+
+            if (con->value()) {
+                con->value()->visit(this);
+            }
+
+            declareSymbol(con->name(), con, "constant", true,
+                          nameBefore(NameSite::AFTER, con->lineStart(), con->columnStart(), con->value()));
+            break;
+        }
+
+        case TO_DECL_GROUP: {
+            DeclGroup* dgrp = static_cast<DeclGroup*>(node);
+            for (auto& decl : dgrp->declarations()) {
+                if (stopped) break;
+                decl->visit(this);
+            }
+            break;
+        }
+
+        case TO_DESTRUCTURE: {
+            DestructuringDecl* destruct = static_cast<DestructuringDecl*>(node);
+
+            // Visit initializer first
+            if (destruct->initExpression()) {
+                destruct->initExpression()->visit(this);
+            }
+
+            // Then declare all bindings, `let { a } = require("m")` ones with the module
+            const char* module = requiredModule(destruct->initExpression());
+            for (VarDecl* decl : destruct->declarations()) {
+                bool readonly = !decl->isAssignable();
+                declareSymbol(decl->name(), decl, readonly ? "binding" : "variable", readonly,
+                              {NameSite::AFTER, decl->lineStart(), decl->columnStart()}, module);
+            }
+            break;
+        }
+
+        case TO_IMPORT:
+            visitImport(static_cast<ImportStmt*>(node));
+            break;
+
+        case TO_FOREACH: {
+            ForeachStatement* loop = static_cast<ForeachStatement*>(node);
+
+            // Visit container first (outside loop scope)
+            if (loop->container()) {
+                loop->container()->visit(this);
+            }
+
+            // Create scope for loop variables
+            pushScope();
+
+            // Skip synthetic surrogates (e.g. "@FE_VAL0") used by the parser
+            // when the val position is a destructuring pattern; the real
+            // bindings are declared when the wrapped DestructuringDecl is visited.
+            // Loop var nodes don't point at the names, search from loop start.
+            if (loop->idx()) {
+                const char* name = loop->idx()->name();
+                if (name && name[0] != '@') {
+                    declareSymbol(name, loop->idx(), "variable", false,
+                                  {NameSite::AFTER, loop->lineStart(), loop->columnStart()});
+                }
+            }
+            if (loop->val()) {
+                const char* name = loop->val()->name();
+                if (name && name[0] != '@') {
+                    declareSymbol(name, loop->val(), "variable", false,
+                                  {NameSite::AFTER, loop->lineStart(), loop->columnStart()});
+                }
+            }
+
+            if (loop->body()) {
+                loop->body()->visit(this);
+            }
+
+            popScope();
+            break;
+        }
+
+        case TO_FOR: {
+            ForStatement* loop = static_cast<ForStatement*>(node);
+
+            // Create scope for loop (for initializer variables)
+            pushScope();
+
+            if (loop->initializer()) loop->initializer()->visit(this);
+            if (loop->condition()) loop->condition()->visit(this);
+            if (loop->modifier()) loop->modifier()->visit(this);
+            if (loop->body()) loop->body()->visit(this);
+
+            popScope();
+            break;
+        }
+
+        case TO_WHILE: {
+            WhileStatement* loop = static_cast<WhileStatement*>(node);
+            if (loop->condition()) loop->condition()->visit(this);
+            if (loop->body()) loop->body()->visit(this);
+            break;
+        }
+
+        case TO_DOWHILE: {
+            DoWhileStatement* loop = static_cast<DoWhileStatement*>(node);
+            if (loop->body()) loop->body()->visit(this);
+            if (loop->condition()) loop->condition()->visit(this);
+            break;
+        }
+
+        case TO_TRY: {
+            TryStatement* tryStmt = static_cast<TryStatement*>(node);
+
+            if (tryStmt->tryStatement()) {
+                tryStmt->tryStatement()->visit(this);
+            }
+
+            // Create scope for catch block
+            pushScope();
+
+            if (Id* exId = tryStmt->exceptionId()) {
+                // Exception var - the Id node has correct position
+                declareSymbol(exId->name(), exId, "exception", false,
+                              {NameSite::AT, exId->lineStart(), exId->columnStart()});
+            }
+
+            if (tryStmt->catchStatement()) {
+                tryStmt->catchStatement()->visit(this);
+            }
+
+            popScope();
+            break;
+        }
+
+        case TO_IF: {
+            IfStatement* ifStmt = static_cast<IfStatement*>(node);
+            if (ifStmt->condition()) ifStmt->condition()->visit(this);
+            if (ifStmt->thenBranch()) ifStmt->thenBranch()->visit(this);
+            if (ifStmt->elseBranch()) ifStmt->elseBranch()->visit(this);
+            break;
+        }
+
+        case TO_SWITCH: {
+            SwitchStatement* sw = static_cast<SwitchStatement*>(node);
+            if (sw->expression()) sw->expression()->visit(this);
+            for (const auto& c : sw->cases()) {
+                if (stopped) break;
+                if (c.val) c.val->visit(this);
+                if (c.stmt) c.stmt->visit(this);
+            }
+            if (sw->defaultCase().stmt) {
+                sw->defaultCase().stmt->visit(this);
+            }
+            break;
+        }
+
+        case TO_RETURN:
+        case TO_YIELD:
+        case TO_THROW: {
+            TerminateStatement* term = static_cast<TerminateStatement*>(node);
+            if (term->argument()) term->argument()->visit(this);
+            break;
+        }
+
+        case TO_EXPR_STMT: {
+            ExprStatement* estmt = static_cast<ExprStatement*>(node);
+            if (estmt->expression()) estmt->expression()->visit(this);
+            break;
+        }
+
+        case TO_ID: {
+            Id* id = static_cast<Id*>(node);
+            const char* name = id->name();
+
+            // Skip special identifiers
+            if (!name || !*name) break;
+            if (strcmp(name, "this") == 0 || strcmp(name, "base") == 0) break;
+
+            // Unknown identifiers (globals, builtins) are not reported
+            if (const ResolvedSymbol* sym = findSymbol(name)) {
+                for (ResolveListener* l : listeners) {
+                    l->onReference(id, *sym);
+                }
+            }
+            break;
+        }
+
+        // TO_TABLE and TO_CLASS are handled as Expr nodes directly (no DeclExpr wrapper)
+
+        case TO_CALL: {
+            CallExpr* call = static_cast<CallExpr*>(node);
+            if (call->callee()) call->callee()->visit(this);
+            for (Expr* arg : call->arguments()) {
+                if (stopped) break;
+                arg->visit(this);
+            }
+            break;
+        }
+
+        case TO_GETFIELD: {
+            GetFieldExpr* gf = static_cast<GetFieldExpr*>(node);
+
+            // Check if this is an enum member access (EnumName.MEMBER)
+            bool enumMember = false;
+            if (gf->receiver() && gf->receiver()->op() == TO_ID) {
+                const ResolvedSymbol* sym = findSymbol(static_cast<Id*>(gf->receiver())->name());
+                enumMember = sym && strcmp(sym->kind, "enum") == 0;
+            }
+
+            // Only visit receiver, the field name is a member access
+            if (gf->receiver()) {
+                gf->receiver()->visit(this);
+            }
+
+            for (ResolveListener* l : listeners) {
+                l->onFieldAccess(gf, enumMember);
+            }
+            break;
+        }
+
+        case TO_SETFIELD: {
+            SetFieldExpr* sf = static_cast<SetFieldExpr*>(node);
+            if (sf->receiver()) sf->receiver()->visit(this);
+            if (sf->value()) sf->value()->visit(this);
+            break;
+        }
+
+        case TO_GETSLOT: {
+            GetSlotExpr* gs = static_cast<GetSlotExpr*>(node);
+            if (gs->receiver()) gs->receiver()->visit(this);
+            if (gs->key()) gs->key()->visit(this);
+            break;
+        }
+
+        case TO_SETSLOT: {
+            SetSlotExpr* ss = static_cast<SetSlotExpr*>(node);
+            if (ss->receiver()) ss->receiver()->visit(this);
+            if (ss->key()) ss->key()->visit(this);
+            if (ss->value()) ss->value()->visit(this);
+            break;
+        }
+
+        case TO_TERNARY: {
+            TerExpr* ter = static_cast<TerExpr*>(node);
+            if (ter->a()) ter->a()->visit(this);
+            if (ter->b()) ter->b()->visit(this);
+            if (ter->c()) ter->c()->visit(this);
+            break;
+        }
+
+        case TO_ARRAY: {
+            ArrayExpr* arr = static_cast<ArrayExpr*>(node);
+            for (Expr* e : arr->initializers()) {
+                if (stopped) break;
+                e->visit(this);
+            }
+            break;
+        }
+
+        case TO_COMMA: {
+            CommaExpr* comma = static_cast<CommaExpr*>(node);
+            for (Expr* e : comma->expressions()) {
+                if (stopped) break;
+                e->visit(this);
+            }
+            break;
+        }
+
+        case TO_TABLE: {
+            TableExpr* tbl = static_cast<TableExpr*>(node);
+            for (const auto& member : tbl->members()) {
+                if (stopped) break;
+                if (member.value) {
+                    member.value->visit(this);
+                }
+            }
+            break;
+        }
+
+        case TO_CODE_BLOCK_EXPR: {
+            CodeBlockExpr* cbe = static_cast<CodeBlockExpr*>(node);
+            if (cbe->block()) {
+                cbe->block()->visit(this);
+            }
+            break;
+        }
+
+        // Binary and unary expressions
+        default:
+            if (TO_NULLC <= op && op <= TO_MODEQ) {
+                BinExpr* bin = static_cast<BinExpr*>(node);
+                if (bin->lhs()) bin->lhs()->visit(this);
+                if (bin->rhs()) bin->rhs()->visit(this);
+            } else if ((TO_NOT <= op && op <= TO_CLONE) || op == TO_PAREN ||
+                       op == TO_DELETE || op == TO_STATIC_MEMO || op == TO_INLINE_CONST) {
+                UnExpr* un = static_cast<UnExpr*>(node);
+                if (un->argument()) un->argument()->visit(this);
+            } else if (op == TO_INC) {
+                IncExpr* inc = static_cast<IncExpr*>(node);
+                if (inc->argument()) inc->argument()->visit(this);
+            }
+            break;
+    }
+}
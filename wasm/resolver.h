@@ -0,0 +1,101 @@
+#pragma once
+
+#include "squirrel.h"
+#include "compiler/compiler.h"
+#include "compiler/ast.h"
+#include <string>
+#include <vector>
+#include "symbol_table.h"
+#include "identifier_index.h"
+#include "cancel.h"
+
+
+// Where the name of a declaration can be found in source
+struct NameSite {
+    enum Kind {
+        AT,        // Name starts exactly at line:col
+        AFTER,     // Name is the first matching identifier token at or after line:col
+        AFTER_AS,  // Name follows the first "as" token at or after line:col
+    };
+
+    Kind kind;
+    int line;  // 1-based
+    int col;   // 0-based
+    // AFTER and AFTER_AS: the name starts before this position (the parameter
+    // list, an initializer), so that the same spelling there is not taken
+    // for it. limitLine 0 for none.
+    int limitLine = 0;
+    int limitCol = 0;
+};
+
+// Position of the name token described by site, which may be on a following
+// line. lineOffsets holds the offset of each line start in source.
+bool locateName(const std::string& source, const std::vector<size_t>& lineOffsets,
+                const IdentifierIndex& identifiers, const NameSite& site,
+                const char* name, size_t nameLen, int& line, int& col);
+
+
+// Receives resolution events from ScopeResolver in traversal order
+class ResolveListener {
+public:
+    virtual ~ResolveListener() {}
+
+    // A name was added to the current scope
+    virtual void onDeclaration(const ResolvedSymbol& /*sym*/, const NameSite& /*site*/) {}
+
+    // An identifier was resolved to a visible declaration
+    virtual void onReference(SQCompilation::Id* /*id*/, const ResolvedSymbol& /*sym*/) {}
+
+    // Field access `receiver.field`, enumMember is set when receiver is a known enum
+    virtual void onFieldAccess(SQCompilation::GetFieldExpr* /*gf*/, bool /*enumMember*/) {}
+};
+
+
+// Traverses the entire AST with scope tracking and reports declarations
+// and resolved identifiers to listeners, so that several consumers
+// (semantic tokens, declaration lookup) share a single walk
+class ScopeResolver : public SQCompilation::Visitor {
+    SymbolTable symbols;
+    std::vector<ResolveListener*> listeners;
+    bool stopped;
+    bool cancelled;
+    CancelPoll cancelPoll;
+    int firstLine;  // Lines of interest, 1-based inclusive
+    int lastLine;
+
+    // Node lies entirely outside the lines of interest
+    bool outsideRange(SQCompilation::Node* node) const {
+        return node->lineEnd() < firstLine || node->lineStart() > lastLine;
+    }
+
+    void declareSymbol(const char* name, SQCompilation::Node* node, const char* kind,
+                       bool isReadonly, const NameSite& site, const char* module = nullptr);
+    const ResolvedSymbol* findSymbol(const char* name) const;
+    void pushScope();
+    void popScope();
+
+    void visitFunction(SQCompilation::FunctionExpr* fn);
+    void visitImport(SQCompilation::ImportStmt* import);
+
+public:
+    ScopeResolver();
+
+    ScopeResolver(const ScopeResolver&) = delete;
+    ScopeResolver& operator=(const ScopeResolver&) = delete;
+
+    void addListener(ResolveListener* listener) { listeners.push_back(listener); }
+
+    // Only report events needed for lines first..last (1-based, inclusive).
+    // Everything that can be in scope there is still declared, but function
+    // bodies and blocks outside the range are skipped and the walk ends after
+    // the last line, so listeners may receive events outside the range too.
+    void setLineRange(int first, int last) { firstLine = first; lastLine = last; }
+
+    // Abandon the rest of the traversal (e.g. lookup already answered)
+    void stop() { stopped = true; }
+    bool isStopped() const { return stopped; }
+    // Stopped because the host cancelled the call, listeners saw part of the tree
+    bool isCancelled() const { return cancelled; }
+
+    void visitNode(SQCompilation::Node* node) override;
+};
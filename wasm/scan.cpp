@@ -0,0 +1,121 @@
+#include "scan.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SCAN_SIMD 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_SIMD 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+static const size_t CHUNK = 16;
+
+static inline bool isIdentChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+#ifdef SCAN_SIMD
+
+static inline unsigned lowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return unsigned(index);
+#else
+    return unsigned(__builtin_ctz(mask));
+#endif
+}
+
+// One bit per byte of a 16-byte chunk
+#if defined(__wasm_simd128__)
+typedef v128_t Chunk;
+static inline Chunk load(const char* p) { return wasm_v128_load(p); }
+static inline Chunk splat(char c) { return wasm_i8x16_splat(c); }
+static inline Chunk equal(Chunk a, Chunk b) { return wasm_i8x16_eq(a, b); }
+static inline Chunk either(Chunk a, Chunk b) { return wasm_v128_or(a, b); }
+static inline Chunk inRange(Chunk x, char lo, char hi) {
+    return wasm_v128_and(wasm_u8x16_ge(x, splat(lo)), wasm_u8x16_le(x, splat(hi)));
+}
+static inline uint32_t bits(Chunk m) { return wasm_i8x16_bitmask(m); }
+#else
+typedef __m128i Chunk;
+static inline Chunk load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+static inline Chunk splat(char c) { return _mm_set1_epi8(c); }
+static inline Chunk equal(Chunk a, Chunk b) { return _mm_cmpeq_epi8(a, b); }
+static inline Chunk either(Chunk a, Chunk b) { return _mm_or_si128(a, b); }
+// SSE2 has no unsigned byte compares, min/max against the bounds stand in
+static inline Chunk inRange(Chunk x, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, splat(lo)), x),
+                         _mm_cmpeq_epi8(_mm_min_epu8(x, splat(hi)), x));
+}
+static inline uint32_t bits(Chunk m) { return uint32_t(_mm_movemask_epi8(m)); }
+#endif
+
+#endif  // SCAN_SIMD
+
+
+void appendLineStarts(const char* data, size_t length, size_t base, std::vector<size_t>& lineStarts) {
+    size_t i = 0;
+#ifdef SCAN_SIMD
+    const Chunk newline = splat('\n');
+    for (; i + CHUNK <= length; i += CHUNK) {
+        uint32_t mask = bits(equal(load(data + i), newline));
+        while (mask) {
+            lineStarts.push_back(base + i + lowestBit(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < length; ++i) {
+        if (data[i] == '\n') lineStarts.push_back(base + i + 1);
+    }
+}
+
+size_t findAnyOf(const char* data, size_t length, size_t pos, const char* set) {
+    size_t setSize = strlen(set);
+#ifdef SCAN_SIMD
+    if (setSize > 0 && setSize <= 5) {
+        // Unused slots repeat the first byte
+        Chunk wanted[5];
+        for (size_t k = 0; k < 5; ++k) wanted[k] = splat(set[k < setSize ? k : 0]);
+
+        for (; pos + CHUNK <= length; pos += CHUNK) {
+            Chunk x = load(data + pos);
+            Chunk hit = either(either(equal(x, wanted[0]), equal(x, wanted[1])),
+                               either(either(equal(x, wanted[2]), equal(x, wanted[3])), equal(x, wanted[4])));
+            uint32_t mask = bits(hit);
+            if (mask) return pos + lowestBit(mask);
+        }
+    }
+#endif
+    for (; pos < length; ++pos) {
+        if (memchr(set, data[pos], setSize)) return pos;
+    }
+    return length;
+}
+
+size_t skipIdentifierChars(const char* data, size_t length, size_t pos) {
+#ifdef SCAN_SIMD
+    // Short names are the common case, so look at the next bytes one by one first
+    for (size_t stop = pos + 8; pos < length && pos < stop; ++pos) {
+        if (!isIdentChar(data[pos])) return pos;
+    }
+    const Chunk underscore = splat('_');
+    for (; pos + CHUNK <= length; pos += CHUNK) {
+        Chunk x = load(data + pos);
+        Chunk ident = either(either(inRange(x, 'a', 'z'), inRange(x, 'A', 'Z')),
+                             either(inRange(x, '0', '9'), equal(x, underscore)));
+        uint32_t mask = ~bits(ident) & 0xFFFFu;
+        if (mask) return pos + lowestBit(mask);
+    }
+#endif
+    while (pos < length && isIdentChar(data[pos])) ++pos;
+    return pos;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+
+// Byte scanning kernels over source text. They look at 16 bytes at a time
+// with WASM SIMD (-msimd128) or SSE2, and fall back to plain loops elsewhere.
+
+// Append i + 1 for every '\n' at data[i], offset by base
+void appendLineStarts(const char* data, size_t length, size_t base, std::vector<size_t>& lineStarts);
+
+// First position at or after pos holding a byte from the given set,
+// length if there is none. Sets hold up to 5 distinct bytes.
+size_t findAnyOf(const char* data, size_t length, size_t pos, const char* set);
+
+// First position at or after pos that is not [A-Za-z0-9_]
+size_t skipIdentifierChars(const char* data, size_t length, size_t pos);
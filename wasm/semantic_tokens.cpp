@@ -5,719 +5,300 @@
 #include <string>
 #include <vector>
 #include <algorithm>
-#include "utils.h"
+#include <string_view>
+#include <unordered_map>
+#include "semantic_tokens.h"
+#include "profile.h"
 
 
 using namespace SQCompilation;
 
 
-// Semantic token extractor for VS Code semantic highlighting
-// Traverses entire AST with scope tracking to classify all identifiers
-class SemanticTokenExtractor : public Visitor {
-    // Token types (must match TypeScript legend order)
-    enum TokenType {
-        TT_VARIABLE = 0,
-        TT_PARAMETER = 1,
-        TT_FUNCTION = 2,
-        TT_CLASS = 3,
-        TT_ENUM = 4,
-        TT_ENUM_MEMBER = 5,
-        TT_PROPERTY = 6,
-        TT_IMPORT = 7
-    };
-
-    // Token modifiers (bitmask, must match TypeScript legend order)
-    enum TokenModifier {
-        TM_DECLARATION = 1 << 0,
-        TM_READONLY = 1 << 1
-    };
-
-    struct SemanticToken {
-        int line;      // 1-based
-        int col;       // 0-based
-        int length;
-        int type;
-        int modifiers;
-    };
-
-    std::vector<SemanticToken> tokens;
-
-    // Source text and line index for finding name positions
-    const std::string& source;
-    std::vector<size_t> lineOffsets;  // Offset of each line start in source
-
-    // Scope tracking (same structure as DeclarationFinder)
-    struct Symbol {
-        const char* name;
-        Node* node;
-        const char* kind;
-        bool isReadonly;
-    };
-
-    struct Scope {
-        std::vector<Symbol> symbols;
-        Scope* parent;
-
-        Scope(Scope* p = nullptr) : parent(p) {}
-    };
-
-    Scope* currentScope;
-    std::vector<Scope*> allScopes;
-
-    void buildLineIndex() {
-        lineOffsets.push_back(0);  // Line 1 starts at offset 0
-        for (size_t i = 0; i < source.size(); ++i) {
-            if (source[i] == '\n') {
-                lineOffsets.push_back(i + 1);
-            }
-        }
-    }
+static SemanticTokenExtractor::TokenType kindToTokenType(const char* kind) {
+    using T = SemanticTokenExtractor;
+    if (strcmp(kind, "variable") == 0) return T::TT_VARIABLE;
+    if (strcmp(kind, "binding") == 0) return T::TT_VARIABLE;
+    if (strcmp(kind, "parameter") == 0) return T::TT_PARAMETER;
+    if (strcmp(kind, "function") == 0) return T::TT_FUNCTION;
+    if (strcmp(kind, "class") == 0) return T::TT_CLASS;
+    if (strcmp(kind, "enum") == 0) return T::TT_ENUM;
+    if (strcmp(kind, "constant") == 0) return T::TT_VARIABLE;
+    if (strcmp(kind, "import") == 0) return T::TT_IMPORT;
+    if (strcmp(kind, "exception") == 0) return T::TT_VARIABLE;
+    return T::TT_VARIABLE;
+}
 
-    // Find name position within a line, starting from startCol
-    // Returns the column where name starts, or -1 if not found
-    int findNameInLine(int line, int startCol, const char* name) {
-        if (line < 1 || line > (int)lineOffsets.size()) return -1;
-
-        size_t lineStart = lineOffsets[line - 1];
-        size_t lineEnd = (line < (int)lineOffsets.size()) ? lineOffsets[line] : source.size();
-
-        size_t searchStart = lineStart + startCol;
-        if (searchStart >= lineEnd) return -1;
-
-        size_t nameLen = strlen(name);
-        const char* linePtr = source.c_str() + searchStart;
-        size_t searchLen = lineEnd - searchStart;
-
-        // Search for the name as a whole word
-        for (size_t i = 0; i + nameLen <= searchLen; ++i) {
-            if (strncmp(linePtr + i, name, nameLen) == 0) {
-                // Check it's a whole word (not part of a larger identifier)
-                bool startOk = (i == 0) || !isalnum(linePtr[i - 1]) && linePtr[i - 1] != '_';
-                bool endOk = (i + nameLen >= searchLen) || (!isalnum(linePtr[i + nameLen]) && linePtr[i + nameLen] != '_');
-                if (startOk && endOk) {
-                    return startCol + (int)i;
-                }
-            }
-        }
-        return -1;
-    }
 
-    void declareSymbol(const char* name, Node* node, const char* kind, bool isReadonly = false) {
-        if (!name || !currentScope) return;
-        currentScope->symbols.push_back({name, node, kind, isReadonly});
-    }
+void SemanticTokenExtractor::addToken(int line, int col, int length, TokenType type, int modifiers) {
+    if (length <= 0 || length > UINT16_MAX || col < 0 || line < firstLine || line > lastLine) return;
+    if (line < 1 || line > (int)lineOffsets.size()) return;
 
-    Symbol* findSymbol(const char* name) {
-        for (Scope* s = currentScope; s; s = s->parent) {
-            for (int i = (int)s->symbols.size() - 1; i >= 0; --i) {
-                if (strcmp(s->symbols[i].name, name) == 0) {
-                    return &s->symbols[i];
-                }
-            }
-        }
-        return nullptr;
-    }
+    // Tokens never span lines, nor cover the newline
+    size_t offset = lineOffsets[line - 1] + col;
+    size_t lineEnd = line < (int)lineOffsets.size() ? lineOffsets[line] - 1 : source.size();
+    if (offset + length > lineEnd) return;
 
-    void pushScope() {
-        Scope* newScope = new Scope(currentScope);
-        allScopes.push_back(newScope);
-        currentScope = newScope;
-    }
+    tokens.push_back({(uint32_t)offset, (uint16_t)length, (uint8_t)type, (uint8_t)modifiers});
+}
 
-    void popScope() {
-        if (currentScope && currentScope->parent) {
-            currentScope = currentScope->parent;
-        }
-    }
+void SemanticTokenExtractor::onDeclaration(const ResolvedSymbol& sym, const NameSite& site) {
+    TokenType type = kindToTokenType(sym.kind);
+    // Imports are readonly when referenced, but their declaration is not marked so
+    int mods = TM_DECLARATION | (sym.isReadonly && type != TT_IMPORT ? TM_READONLY : 0);
+    int len = (int)strlen(sym.name);
 
-    void addToken(int line, int col, int length, TokenType type, int modifiers) {
-        if (length > 0 && col >= 0) {
-            tokens.push_back({line, col, length, type, modifiers});
-        }
-    }
+    int line, col;
+    if (locateName(source, lineOffsets, identifiers, site, sym.name, len, line, col))
+        addToken(line, col, len, type, mods);
+}
 
-    void addTokenForNode(Node* node, int length, TokenType type, int modifiers) {
-        addToken(node->lineStart(), node->columnStart(), length, type, modifiers);
-    }
+void SemanticTokenExtractor::onReference(Id* id, const ResolvedSymbol& sym) {
+    int mods = sym.isReadonly ? TM_READONLY : 0;
+    addToken(id->lineStart(), id->columnStart(), (int)strlen(sym.name), kindToTokenType(sym.kind), mods);
+}
 
-    // Add token for a named declaration, searching for the name in source
-    void addTokenForNamedDecl(Node* node, const char* name, TokenType type, int modifiers) {
-        if (!name || !*name) return;
-        int len = (int)strlen(name);
-        int line = node->lineStart();
-        int col = findNameInLine(line, node->columnStart(), name);
-        if (col >= 0) {
-            addToken(line, col, len, type, modifiers);
-        }
+void SemanticTokenExtractor::onFieldAccess(GetFieldExpr* gf, bool enumMember) {
+    const char* fieldName = gf->fieldName();
+    if (!fieldName || !*fieldName) return;
+
+    // Calculate field position: end of expression minus field length
+    int fieldLen = (int)strlen(fieldName);
+    int fieldCol = gf->columnEnd() - fieldLen;
+    if (enumMember) {
+        addToken(gf->lineEnd(), fieldCol, fieldLen, TT_ENUM_MEMBER, TM_READONLY);
+    } else {
+        addToken(gf->lineEnd(), fieldCol, fieldLen, TT_PROPERTY, 0);
     }
+}
 
-    TokenType kindToTokenType(const char* kind) {
-        if (strcmp(kind, "variable") == 0) return TT_VARIABLE;
-        if (strcmp(kind, "binding") == 0) return TT_VARIABLE;
-        if (strcmp(kind, "parameter") == 0) return TT_PARAMETER;
-        if (strcmp(kind, "function") == 0) return TT_FUNCTION;
-        if (strcmp(kind, "class") == 0) return TT_CLASS;
-        if (strcmp(kind, "enum") == 0) return TT_ENUM;
-        if (strcmp(kind, "constant") == 0) return TT_VARIABLE;
-        if (strcmp(kind, "import") == 0) return TT_IMPORT;
-        if (strcmp(kind, "exception") == 0) return TT_VARIABLE;
-        return TT_VARIABLE;
+// Sort tokens by position - VS Code requires this.
+// The resolver reports them in traversal order, which is source order except
+// where it visits a subtree out of order, so the list is a few ascending
+// runs. Merging those is linear for an ordered list.
+void SemanticTokenExtractor::sortTokens() {
+    ProfileScope profile(PROFILE_SORT);
+    auto before = [](const SemanticToken& a, const SemanticToken& b) { return a.offset < b.offset; };
+
+    std::vector<size_t> runs;  // Run starts, then the end
+    runs.push_back(0);
+    for (size_t i = 1; i < tokens.size(); ++i) {
+        if (before(tokens[i], tokens[i - 1])) runs.push_back(i);
     }
-
-    const char* getClassName(ClassExpr* cls) {
-        if (cls->classKey() && cls->classKey()->op() == TO_ID) {
-            return static_cast<Id*>(cls->classKey())->name();
+    runs.push_back(tokens.size());
+
+    // Merge neighbouring runs pairwise until one is left
+    while (runs.size() > 2) {
+        size_t kept = 0, r = 0;
+        for (; r + 2 < runs.size(); r += 2) {
+            std::inplace_merge(tokens.begin() + runs[r], tokens.begin() + runs[r + 1],
+                               tokens.begin() + runs[r + 2], before);
+            runs[kept++] = runs[r];
+        }
+        for (; r < runs.size(); ++r) {
+            runs[kept++] = runs[r];
         }
-        return nullptr;
+        runs.resize(kept);
     }
+}
 
-public:
-    SemanticTokenExtractor(const std::string& src) : source(src), currentScope(nullptr) {
-        buildLineIndex();
-        pushScope();
+template<typename F>
+void SemanticTokenExtractor::forEachToken(F f) {
+    size_t line = 0;  // 0-based, only moves forward as tokens are sorted
+    for (const auto& tok : tokens) {
+        while (line + 1 < lineOffsets.size() && lineOffsets[line + 1] <= tok.offset) ++line;
+        f((int)line + 1, (int)(tok.offset - lineOffsets[line]), tok);
     }
+}
 
-    ~SemanticTokenExtractor() {
-        for (Scope* s : allScopes) {
-            delete s;
-        }
-    }
+void SemanticTokenExtractor::writeJson(std::ostringstream& out) {
+    sortTokens();
+    ProfileScope profile(PROFILE_SERIALIZE);
+
+    bool first = true;
+    forEachToken([&](int line, int col, const SemanticToken& tok) {
+        if (!first) out << ",";
+        first = false;
+        out << "{\"line\":" << line
+            << ",\"col\":" << col
+            << ",\"length\":" << tok.length
+            << ",\"type\":" << (int)tok.type
+            << ",\"modifiers\":" << (int)tok.modifiers << "}";
+    });
+}
 
-    std::string toJson() {
-        // Sort tokens by position (line, then column) - VS Code requires this
-        std::sort(tokens.begin(), tokens.end(), [](const SemanticToken& a, const SemanticToken& b) {
-            if (a.line != b.line) return a.line < b.line;
-            return a.col < b.col;
-        });
-
-        std::ostringstream out;
-        out << "{\"tokens\":[";
-        bool first = true;
-        for (const auto& tok : tokens) {
-            if (!first) out << ",";
-            first = false;
-            out << "{\"line\":" << tok.line
-                << ",\"col\":" << tok.col
-                << ",\"length\":" << tok.length
-                << ",\"type\":" << tok.type
-                << ",\"modifiers\":" << tok.modifiers << "}";
+std::string SemanticTokenExtractor::toJson() {
+    std::ostringstream out;
+    out << "{\"tokens\":[";
+    writeJson(out);
+    out << "]}";
+    return out.str();
+}
+
+// Hash of the UTF-16 form of a UTF-8 name, wrapping like JS int32 math
+static int32_t nameHash(std::string_view name) {
+    uint32_t hash = 0;
+    auto add = [&hash](uint32_t unit) { hash = hash * 31 + unit; };
+    for (size_t i = 0; i < name.size(); ) {
+        unsigned char c = (unsigned char)name[i];
+        int seqLen = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+        if (i + seqLen > name.size()) seqLen = 1;
+        uint32_t cp = seqLen == 1 ? c : c & (0xFF >> (seqLen + 1));
+        for (int k = 1; k < seqLen; ++k) cp = (cp << 6) | ((unsigned char)name[i + k] & 0x3F);
+        if (cp >= 0x10000) {
+            add(0xD800 + ((cp - 0x10000) >> 10));
+            add(0xDC00 + ((cp - 0x10000) & 0x3FF));
+        } else {
+            add(cp);
         }
-        out << "]}";
-        return out.str();
+        i += seqLen;
     }
+    return (int32_t)hash;
+}
 
-    void visitNode(Node* node) override {
-        TreeOp op = node->op();
-
-        switch (op) {
-            case TO_BLOCK: {
-                Block* block = static_cast<Block*>(node);
-                bool needsScope = !block->isRoot();
-                if (needsScope) pushScope();
-
-                for (Statement* stmt : block->statements()) {
-                    stmt->visit(this);
-                }
-
-                if (needsScope) popScope();
-                break;
-            }
-
-            case TO_FUNCTION: {
-                FunctionExpr* fn = static_cast<FunctionExpr*>(node);
-                const char* name = fn->name();
-
-                // Emit token for function name declaration
-                if (name && *name) {
-                    addTokenForNamedDecl(fn, name, TT_FUNCTION, TM_DECLARATION);
-                    declareSymbol(name, fn, "function", false);
-                }
-
-                pushScope();
-
-                // Add parameters - ParamDecl position is at the param name
-                for (ParamDecl* param : fn->parameters()) {
-                    if (DestructuringDecl* destruct = param->getDestructuring()) {
-                        // Destructured params have synthetic names like @arg1
-                        // Emit tokens for the actual bindings inside
-                        for (VarDecl* decl : destruct->declarations()) {
-                            const char* dname = decl->name();
-                            bool readonly = !decl->isAssignable();
-                            if (dname && *dname) {
-                                int mods = TM_DECLARATION | (readonly ? TM_READONLY : 0);
-                                addTokenForNamedDecl(decl, dname, TT_PARAMETER, mods);
-                                declareSymbol(dname, decl, "parameter", readonly);
-                            }
-                        }
-                        continue;
-                    }
-
-                    const char* pname = param->name();
-                    if (pname && *pname) {
-                        int len = (int)strlen(pname);
-                        addTokenForNode(param, len, TT_PARAMETER, TM_DECLARATION);
-                        declareSymbol(pname, param, "parameter", false);
-                    }
-                }
-
-                if (fn->body()) {
-                    fn->body()->visit(this);
-                }
-
-                popScope();
-                break;
-            }
-
-            case TO_CLASS: {
-                ClassExpr* cls = static_cast<ClassExpr*>(node);
-                const char* name = getClassName(cls);
-
-                if (name) {
-                    // Emit token for class key (the identifier)
-                    Id* classKey = static_cast<Id*>(cls->classKey());
-                    int len = (int)strlen(name);
-                    addTokenForNode(classKey, len, TT_CLASS, TM_DECLARATION);
-                    declareSymbol(name, cls, "class", false);
-                }
-
-                // Visit class base if present
-                if (cls->classBase()) {
-                    cls->classBase()->visit(this);
-                }
-
-                // Visit members
-                for (const auto& member : cls->members()) {
-                    if (member.value) {
-                        member.value->visit(this);
-                    }
-                }
-                break;
-            }
-
-            case TO_ENUM: {
-                EnumDecl* enm = static_cast<EnumDecl*>(node);
-                const char* name = enm->name();
-
-                if (name && *name) {
-                    addTokenForNamedDecl(enm, name, TT_ENUM, TM_DECLARATION);
-                    declareSymbol(name, enm, "enum", false);
-                }
-                // Enum members are accessed as EnumName.Member, handled in GETFIELD
-                break;
-            }
-
-            case TO_VAR: {
-                VarDecl* var = static_cast<VarDecl*>(node);
-                const char* name = var->name();
-                bool readonly = !var->isAssignable();
-
-                // Visit initializer first (before declaring)
-                if (var->initializer()) {
-                    var->initializer()->visit(this);
-                }
-
-                // Emit token for variable name
-                if (name && *name) {
-                    int mods = TM_DECLARATION | (readonly ? TM_READONLY : 0);
-                    addTokenForNamedDecl(var, name, TT_VARIABLE, mods);
-                    declareSymbol(name, var, readonly ? "binding" : "variable", readonly);
-                }
-                break;
-            }
-
-            case TO_CONST: {
-                ConstDecl* con = static_cast<ConstDecl*>(node);
-                const char* name = con->name();
-
-                if (con->value()) {
-                    con->value()->visit(this);
-                }
-
-                if (name && *name) {
-                    addTokenForNamedDecl(con, name, TT_VARIABLE, TM_DECLARATION | TM_READONLY);
-                    declareSymbol(name, con, "constant", true);
-                }
-                break;
-            }
-
-            case TO_DECL_GROUP: {
-                DeclGroup* dgrp = static_cast<DeclGroup*>(node);
-                for (auto& decl : dgrp->declarations()) {
-                    decl->visit(this);
-                }
-                break;
-            }
-
-            case TO_DESTRUCTURE: {
-                DestructuringDecl* destruct = static_cast<DestructuringDecl*>(node);
-
-                if (destruct->initExpression()) {
-                    destruct->initExpression()->visit(this);
-                }
-
-                for (VarDecl* decl : destruct->declarations()) {
-                    const char* name = decl->name();
-                    bool readonly = !decl->isAssignable();
-                    if (name && *name) {
-                        int mods = TM_DECLARATION | (readonly ? TM_READONLY : 0);
-                        addTokenForNamedDecl(decl, name, TT_VARIABLE, mods);
-                        declareSymbol(name, decl, readonly ? "binding" : "variable", readonly);
-                    }
-                }
-                break;
-            }
-
-            case TO_IMPORT: {
-                ImportStmt* import = static_cast<ImportStmt*>(node);
-
-                if (import->slots.empty()) {
-                    // import "module" as alias
-                    const char* name = import->moduleAlias ? import->moduleAlias : nullptr;
-                    if (name) {
-                        // Search for the alias after "as" keyword to avoid matching in module path
-                        int line = import->lineStart();
-                        int len = (int)strlen(name);
-                        // Find " as " first, then search for alias after it
-                        int asCol = findNameInLine(line, import->columnStart(), "as");
-                        if (asCol >= 0) {
-                            int aliasCol = findNameInLine(line, asCol + 2, name);
-                            if (aliasCol >= 0) {
-                                addToken(line, aliasCol, len, TT_IMPORT, TM_DECLARATION);
-                            }
-                        }
-                        declareSymbol(name, import, "import", true);
-                    }
-                } else {
-                    // from "module" import name, name as alias, ...
-                    for (const SQModuleImportSlot& slot : import->slots) {
-                        if (strcmp(slot.name, "*") == 0) continue;
-
-                        // Use slot's line/column directly - it points to the imported name
-                        int len;
-                        int line = slot.line;
-                        int col = slot.column;
-
-                        if (slot.alias) {
-                            // If there's an alias, we need to find its position
-                            // The alias comes after "name as alias", so search after slot position
-                            const char* name = slot.alias;
-                            len = (int)strlen(name);
-                            // Search for alias after the original name position
-                            int aliasCol = findNameInLine(line, col + (int)strlen(slot.name), name);
-                            if (aliasCol >= 0) {
-                                addToken(line, aliasCol, len, TT_IMPORT, TM_DECLARATION);
-                            }
-                            declareSymbol(name, import, "import", true);
-                        } else {
-                            // No alias - use slot position directly
-                            len = (int)strlen(slot.name);
-                            addToken(line, col, len, TT_IMPORT, TM_DECLARATION);
-                            declareSymbol(slot.name, import, "import", true);
-                        }
-                    }
-                }
-                break;
-            }
-
-            case TO_FOREACH: {
-                ForeachStatement* loop = static_cast<ForeachStatement*>(node);
-
-                if (loop->container()) {
-                    loop->container()->visit(this);
-                }
-
-                pushScope();
-
-                if (loop->idx()) {
-                    const char* name = loop->idx()->name();
-                    if (name && *name && name[0] != '@') {
-                        // foreach loop vars - search for name in source
-                        addTokenForNamedDecl(loop, name, TT_VARIABLE, TM_DECLARATION);
-                        declareSymbol(name, loop->idx(), "variable", false);
-                    }
-                }
-                if (loop->val()) {
-                    const char* name = loop->val()->name();
-                    // Skip synthetic surrogates (e.g. "@FE_VAL0") used by the parser
-                    // when the val position is a destructuring pattern; the real
-                    // bindings are emitted when the wrapped DestructuringDecl is visited.
-                    if (name && *name && name[0] != '@') {
-                        addTokenForNamedDecl(loop, name, TT_VARIABLE, TM_DECLARATION);
-                        declareSymbol(name, loop->val(), "variable", false);
-                    }
-                }
-
-                if (loop->body()) {
-                    loop->body()->visit(this);
-                }
-
-                popScope();
-                break;
-            }
-
-            case TO_FOR: {
-                ForStatement* loop = static_cast<ForStatement*>(node);
-
-                pushScope();
-
-                if (loop->initializer()) loop->initializer()->visit(this);
-                if (loop->condition()) loop->condition()->visit(this);
-                if (loop->modifier()) loop->modifier()->visit(this);
-                if (loop->body()) loop->body()->visit(this);
-
-                popScope();
-                break;
-            }
-
-            case TO_WHILE: {
-                WhileStatement* loop = static_cast<WhileStatement*>(node);
-                if (loop->condition()) loop->condition()->visit(this);
-                if (loop->body()) loop->body()->visit(this);
-                break;
-            }
-
-            case TO_DOWHILE: {
-                DoWhileStatement* loop = static_cast<DoWhileStatement*>(node);
-                if (loop->body()) loop->body()->visit(this);
-                if (loop->condition()) loop->condition()->visit(this);
-                break;
-            }
-
-            case TO_TRY: {
-                TryStatement* tryStmt = static_cast<TryStatement*>(node);
-
-                if (tryStmt->tryStatement()) {
-                    tryStmt->tryStatement()->visit(this);
-                }
-
-                pushScope();
-
-                if (tryStmt->exceptionId()) {
-                    const char* name = tryStmt->exceptionId()->name();
-                    if (name && *name) {
-                        // Exception var - the Id node should have correct position
-                        int len = (int)strlen(name);
-                        addTokenForNode(tryStmt->exceptionId(), len, TT_VARIABLE, TM_DECLARATION);
-                        declareSymbol(name, tryStmt->exceptionId(), "exception", false);
-                    }
-                }
-
-                if (tryStmt->catchStatement()) {
-                    tryStmt->catchStatement()->visit(this);
-                }
-
-                popScope();
-                break;
-            }
-
-            case TO_IF: {
-                IfStatement* ifStmt = static_cast<IfStatement*>(node);
-                if (ifStmt->condition()) ifStmt->condition()->visit(this);
-                if (ifStmt->thenBranch()) ifStmt->thenBranch()->visit(this);
-                if (ifStmt->elseBranch()) ifStmt->elseBranch()->visit(this);
-                break;
-            }
-
-            case TO_SWITCH: {
-                SwitchStatement* sw = static_cast<SwitchStatement*>(node);
-                if (sw->expression()) sw->expression()->visit(this);
-                for (const auto& c : sw->cases()) {
-                    if (c.val) c.val->visit(this);
-                    if (c.stmt) c.stmt->visit(this);
-                }
-                if (sw->defaultCase().stmt) {
-                    sw->defaultCase().stmt->visit(this);
-                }
-                break;
-            }
-
-            case TO_RETURN:
-            case TO_YIELD:
-            case TO_THROW: {
-                TerminateStatement* term = static_cast<TerminateStatement*>(node);
-                if (term->argument()) term->argument()->visit(this);
-                break;
-            }
-
-            case TO_EXPR_STMT: {
-                ExprStatement* estmt = static_cast<ExprStatement*>(node);
-                if (estmt->expression()) estmt->expression()->visit(this);
-                break;
-            }
-
-            case TO_ID: {
-                Id* id = static_cast<Id*>(node);
-                const char* name = id->name();
-
-                // Skip special identifiers
-                if (!name || !*name) break;
-                if (strcmp(name, "this") == 0 || strcmp(name, "base") == 0) break;
-
-                Symbol* sym = findSymbol(name);
-                if (sym) {
-                    TokenType type = kindToTokenType(sym->kind);
-                    int mods = sym->isReadonly ? TM_READONLY : 0;
-                    int len = (int)strlen(name);
-                    addTokenForNode(id, len, type, mods);
-                }
-                // Unknown identifiers (globals, builtins) - don't emit token
-                break;
-            }
-
-            // TO_TABLE and TO_CLASS are handled as Expr nodes directly (no DeclExpr wrapper)
-
-            case TO_CALL: {
-                CallExpr* call = static_cast<CallExpr*>(node);
-                if (call->callee()) call->callee()->visit(this);
-                for (Expr* arg : call->arguments()) {
-                    arg->visit(this);
-                }
-                break;
-            }
-
-            case TO_GETFIELD: {
-                GetFieldExpr* gf = static_cast<GetFieldExpr*>(node);
-
-                // Check if this is an enum member access (EnumName.MEMBER)
-                if (gf->receiver() && gf->receiver()->op() == TO_ID) {
-                    Id* receiver = static_cast<Id*>(gf->receiver());
-                    Symbol* sym = findSymbol(receiver->name());
-                    if (sym && strcmp(sym->kind, "enum") == 0) {
-                        // Emit enum token for receiver
-                        int len = (int)strlen(receiver->name());
-                        addTokenForNode(receiver, len, TT_ENUM, 0);
-
-                        // Emit enumMember token for field
-                        const char* fieldName = gf->fieldName();
-                        if (fieldName && *fieldName) {
-                            // Calculate field position: end of expression minus field length
-                            int fieldLen = (int)strlen(fieldName);
-                            int fieldCol = gf->columnEnd() - fieldLen;
-                            addToken(gf->lineEnd(), fieldCol, fieldLen, TT_ENUM_MEMBER, TM_READONLY);
-                        }
-                        break;
-                    }
-                }
-
-                // Regular field access - visit receiver, emit property for field
-                if (gf->receiver()) {
-                    gf->receiver()->visit(this);
-                }
-
-                // Emit property token for field name
-                const char* fieldName = gf->fieldName();
-                if (fieldName && *fieldName) {
-                    int fieldLen = (int)strlen(fieldName);
-                    int fieldCol = gf->columnEnd() - fieldLen;
-                    addToken(gf->lineEnd(), fieldCol, fieldLen, TT_PROPERTY, 0);
-                }
-                break;
-            }
-
-            case TO_SETFIELD: {
-                SetFieldExpr* sf = static_cast<SetFieldExpr*>(node);
-                if (sf->receiver()) sf->receiver()->visit(this);
-                // Note: SetFieldExpr doesn't have fieldName() accessor, so we skip the field token
-                if (sf->value()) sf->value()->visit(this);
-                break;
-            }
-
-            case TO_GETSLOT: {
-                GetSlotExpr* gs = static_cast<GetSlotExpr*>(node);
-                if (gs->receiver()) gs->receiver()->visit(this);
-                if (gs->key()) gs->key()->visit(this);
-                break;
-            }
-
-            case TO_SETSLOT: {
-                SetSlotExpr* ss = static_cast<SetSlotExpr*>(node);
-                if (ss->receiver()) ss->receiver()->visit(this);
-                if (ss->key()) ss->key()->visit(this);
-                if (ss->value()) ss->value()->visit(this);
-                break;
-            }
-
-            case TO_TERNARY: {
-                TerExpr* ter = static_cast<TerExpr*>(node);
-                if (ter->a()) ter->a()->visit(this);
-                if (ter->b()) ter->b()->visit(this);
-                if (ter->c()) ter->c()->visit(this);
-                break;
-            }
-
-            case TO_ARRAY: {
-                ArrayExpr* arr = static_cast<ArrayExpr*>(node);
-                for (Expr* e : arr->initializers()) {
-                    e->visit(this);
-                }
-                break;
-            }
-
-            case TO_COMMA: {
-                CommaExpr* comma = static_cast<CommaExpr*>(node);
-                for (Expr* e : comma->expressions()) {
-                    e->visit(this);
-                }
-                break;
-            }
-
-            case TO_TABLE: {
-                TableExpr* tbl = static_cast<TableExpr*>(node);
-                for (const auto& member : tbl->members()) {
-                    if (member.value) {
-                        member.value->visit(this);
-                    }
-                }
-                break;
-            }
-
-            case TO_CODE_BLOCK_EXPR: {
-                CodeBlockExpr* cbe = static_cast<CodeBlockExpr*>(node);
-                if (cbe->block()) {
-                    cbe->block()->visit(this);
-                }
-                break;
-            }
-
-            // Binary and unary expressions
-            default:
-                if (TO_NULLC <= op && op <= TO_MODEQ) {
-                    BinExpr* bin = static_cast<BinExpr*>(node);
-                    if (bin->lhs()) bin->lhs()->visit(this);
-                    if (bin->rhs()) bin->rhs()->visit(this);
-                } else if ((TO_NOT <= op && op <= TO_CLONE) || op == TO_PAREN ||
-                           op == TO_DELETE || op == TO_STATIC_MEMO || op == TO_INLINE_CONST) {
-                    UnExpr* un = static_cast<UnExpr*>(node);
-                    if (un->argument()) un->argument()->visit(this);
-                } else if (op == TO_INC) {
-                    IncExpr* inc = static_cast<IncExpr*>(node);
-                    if (inc->argument()) inc->argument()->visit(this);
-                }
-                break;
+void SemanticTokenExtractor::toPacked(PackedSemanticTokens& packed) {
+    sortTokens();
+    ProfileScope profile(PROFILE_SERIALIZE);
+
+    packed.data.clear();
+    packed.nameIds.clear();
+    packed.nameHashes.clear();
+    packed.data.reserve(tokens.size() * 5);
+    packed.nameIds.reserve(tokens.size());
+
+    std::unordered_map<std::string_view, int32_t> nameIndex;
+    int prevLine = 0, prevCol = 0;
+
+    forEachToken([&](int tokLine, int col, const SemanticToken& tok) {
+        int line = tokLine - 1;  // Packed layout uses 0-based lines
+        int deltaLine = line - prevLine;
+        packed.data.push_back(deltaLine);
+        packed.data.push_back(deltaLine == 0 ? col - prevCol : col);
+        packed.data.push_back(tok.length);
+        packed.data.push_back(tok.type);
+        packed.data.push_back(tok.modifiers);
+        prevLine = line;
+        prevCol = col;
+
+        // Token text is the identifier itself, take it from source
+        std::string_view name(source.data() + tok.offset, tok.length);
+        auto res = nameIndex.emplace(name, (int32_t)nameIndex.size());
+        if (res.second) {
+            packed.nameHashes.push_back(nameHash(name));
         }
+        packed.nameIds.push_back(res.first->second);
+    });
+}
+
+
+// Whole document when lastLine is 0. False if the call was cancelled
+// part way, leaving only some of the tokens.
+static bool collectTokens(SqASTData* astData, SemanticTokenExtractor& extractor,
+                          int firstLine, int lastLine) {
+    ScopeResolver resolver;
+    if (lastLine > 0) {
+        extractor.setLineRange(firstLine, lastLine);
+        resolver.setLineRange(firstLine, lastLine);
     }
-};
+    resolver.addListener(&extractor);
+    ProfileScope profile(PROFILE_WALK);
+    astData->root->visit(&resolver);
+    return !resolver.isCancelled();
+}
 
-std::string extractSemanticTokens(const std::string& source) {
-    HSQUIRRELVM vm = sq_open(256);
-    if (!vm) {
+static std::string extractTokens(DocumentSession& doc, int firstLine, int lastLine) {
+    SqASTData* astData = doc.ast();
+
+    if (!astData) {
         return "{\"tokens\":[]}";
     }
 
-    SqASTData* astData = sq_parsetoast(vm, source.c_str(), source.length(),
-                                        "document", SQFalse, SQFalse);
+    SemanticTokenExtractor extractor(doc.source, doc.lines(), doc.identifiers());
+    collectTokens(astData, extractor, firstLine, lastLine);
+    return extractor.toJson();
+}
+
+std::string extractSemanticTokens(const std::string& source) {
+    DocumentSession doc(source);
+    return extractTokens(doc, 1, 0);
+}
 
-    if (!astData || !astData->root) {
-        sq_close(vm);
+std::string extractSemanticTokensRange(const std::string& source, int firstLine, int lastLine) {
+    DocumentSession doc(source);
+    return extractTokens(doc, firstLine, lastLine);
+}
+
+std::string documentSemanticTokens(int docId) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc) {
         return "{\"tokens\":[]}";
     }
+    return extractTokens(*doc, 1, 0);
+}
 
-    SemanticTokenExtractor extractor(source);
-    astData->root->visit(&extractor);
+// Whole-document tokens are kept until the text changes, so that the
+// decorations and the semantic tokens provider share one walk
+const PackedSemanticTokens* documentSemanticTokensPacked(int docId, int firstLine, int lastLine) {
+    DocumentSession* doc = findDocumentSession(docId);
+    if (!doc) return nullptr;
+
+    bool full = lastLine <= 0;
+    if (full && doc->packedTokensFull) return &doc->packedTokens;
+
+    SqASTData* astData = doc->ast();
+    PackedSemanticTokens& packed = full ? doc->packedTokens : doc->rangeTokens;
+
+    bool complete = true;
+    if (!astData) {
+        packed.data.clear();
+        packed.nameIds.clear();
+        packed.nameHashes.clear();
+    } else {
+        SemanticTokenExtractor extractor(doc->source, doc->lines(), doc->identifiers());
+        complete = collectTokens(astData, extractor, firstLine, lastLine);
+        extractor.toPacked(packed);
+    }
+    if (full) doc->packedTokensFull = complete;
+    return &packed;
+}
 
-    std::string result = extractor.toJson();
+static int nextTokensResultId = 1;
+
+// Tokens are delta-encoded, so an edit leaves the arrays equal up to the
+// first changed token and from the token after the last one: replacing
+// what lies between the common prefix and suffix is a minimal edit
+const SemanticTokensDelta* documentSemanticTokensDelta(int docId, int previousResultId) {
+    const PackedSemanticTokens* packed = documentSemanticTokensPacked(docId, 1, 0);
+    if (!packed) return nullptr;
+    DocumentSession* doc = findDocumentSession(docId);
+    // Keep the base the caller has, partial tokens would replace it
+    if (!doc->packedTokensFull) return nullptr;
+
+    const std::vector<int32_t>& current = packed->data;
+    const std::vector<int32_t>& previous = doc->deltaBase;
+    SemanticTokensDelta& delta = doc->tokensDelta;
+    delta.full = previousResultId <= 0 || previousResultId != doc->deltaBaseId;
+
+    if (delta.full) {
+        delta.start = 0;
+        delta.deleteCount = 0;
+        delta.data = current.data();
+        delta.size = current.size();
+    } else {
+        size_t common = std::min(current.size(), previous.size());
+        size_t prefix = 0;
+        while (prefix < common && current[prefix] == previous[prefix]) ++prefix;
+        size_t suffix = 0;
+        while (suffix < common - prefix &&
+               current[current.size() - 1 - suffix] == previous[previous.size() - 1 - suffix]) ++suffix;
+
+        delta.start = (int)prefix;
+        delta.deleteCount = (int)(previous.size() - prefix - suffix);
+        delta.data = current.data() + prefix;
+        delta.size = current.size() - prefix - suffix;
+    }
 
-    sq_releaseASTData(vm, astData);
-    sq_close(vm);
-    return result;
+    doc->deltaBase = current;
+    doc->deltaBaseId = nextTokensResultId++;
+    delta.resultId = doc->deltaBaseId;
+    return &delta;
 }
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <stdint.h>
+#include "resolver.h"
+#include "document.h"
+
+
+// Semantic token collector for VS Code semantic highlighting.
+// Classifies declarations and identifiers reported by ScopeResolver.
+class SemanticTokenExtractor : public ResolveListener {
+public:
+    // Token types (must match TypeScript legend order)
+    enum TokenType {
+        TT_VARIABLE = 0,
+        TT_PARAMETER = 1,
+        TT_FUNCTION = 2,
+        TT_CLASS = 3,
+        TT_ENUM = 4,
+        TT_ENUM_MEMBER = 5,
+        TT_PROPERTY = 6,
+        TT_IMPORT = 7
+    };
+
+    // Token modifiers (bitmask, must match TypeScript legend order)
+    enum TokenModifier {
+        TM_DECLARATION = 1 << 0,
+        TM_READONLY = 1 << 1
+    };
+
+    SemanticTokenExtractor(const std::string& src, const std::vector<size_t>& lines,
+                           const IdentifierIndex& idents)
+        : source(src), lineOffsets(lines), identifiers(idents), firstLine(1), lastLine(INT_MAX) {}
+
+    // Keep only tokens on lines first..last (1-based, inclusive)
+    void setLineRange(int first, int last) { firstLine = first; lastLine = last; }
+
+    void onDeclaration(const ResolvedSymbol& sym, const NameSite& site) override;
+    void onReference(SQCompilation::Id* id, const ResolvedSymbol& sym) override;
+    void onFieldAccess(SQCompilation::GetFieldExpr* gf, bool enumMember) override;
+
+    // Tokens as comma-separated JSON objects, sorted by position
+    void writeJson(std::ostringstream& out);
+    std::string toJson();
+    void toPacked(PackedSemanticTokens& packed);
+
+private:
+    // Position as a source offset, so that tokens order by a single compare.
+    // Line and column are recovered in order while writing them out.
+    struct SemanticToken {
+        uint32_t offset;
+        uint16_t length;
+        uint8_t type;
+        uint8_t modifiers;
+    };
+
+    std::vector<SemanticToken> tokens;
+
+    // Source text, line index and identifier tokens for finding name positions
+    const std::string& source;
+    const std::vector<size_t>& lineOffsets;  // Offset of each line start in source
+    const IdentifierIndex& identifiers;
+    int firstLine;
+    int lastLine;
+
+    void addToken(int line, int col, int length, TokenType type, int modifiers);
+    void sortTokens();
+    // Calls f(line, col, token) in position order, line 1-based and col 0-based
+    template<typename F> void forEachToken(F f);
+};
@@ -0,0 +1,113 @@
+#include "symbol_table.h"
+#include <string.h>
+
+
+static const size_t INITIAL_CAPACITY = 256;
+
+// FNV-1a, also measures the string
+static uint32_t hashName(const char* name, size_t& length) {
+    uint32_t h = 2166136261u;
+    const char* p = name;
+    for (; *p; ++p) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    length = p - name;
+    return h;
+}
+
+
+SymbolTable::SymbolTable(Arena& arena)
+    : arena(arena), arenaStart(arena.mark()), capacity(INITIAL_CAPACITY), count(0) {
+    slots = arena.makeArray<NameEntry*>(capacity);
+    memset(slots, 0, capacity * sizeof(NameEntry*));
+    scopeStarts.push_back(0);  // Root scope
+}
+
+SymbolTable::~SymbolTable() {
+    arena.rewind(arenaStart);
+}
+
+SymbolTable::NameEntry* const* SymbolTable::findSlot(const char* name, size_t length,
+                                                     uint32_t hash) const {
+    size_t mask = capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        NameEntry* e = slots[i];
+        if (!e || (e->hash == hash && e->length == length && memcmp(e->name, name, length) == 0)) {
+            return &slots[i];
+        }
+    }
+}
+
+void SymbolTable::grow() {
+    NameEntry** old = slots;
+    size_t oldCapacity = capacity;
+
+    // Old slot array stays in the arena until the table goes away
+    capacity *= 2;
+    slots = arena.makeArray<NameEntry*>(capacity);
+    memset(slots, 0, capacity * sizeof(NameEntry*));
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (NameEntry* e = old[i]) {
+            size_t j = e->hash & mask;
+            while (slots[j]) j = (j + 1) & mask;
+            slots[j] = e;
+        }
+    }
+}
+
+SymbolTable::NameEntry* SymbolTable::intern(const char* name) {
+    size_t length;
+    uint32_t hash = hashName(name, length);
+
+    NameEntry** slot = const_cast<NameEntry**>(findSlot(name, length, hash));
+    if (*slot) return *slot;
+
+    // Keep load factor under 1/2
+    if ((count + 1) * 2 > capacity) {
+        grow();
+        slot = const_cast<NameEntry**>(findSlot(name, length, hash));
+    }
+
+    *slot = arena.make<NameEntry>(name, length, hash, nullptr);
+    ++count;
+    return *slot;
+}
+
+void SymbolTable::pushScope() {
+    scopeStarts.push_back(declared.size());
+}
+
+void SymbolTable::popScope() {
+    if (scopeStarts.size() <= 1) return;
+
+    size_t start = scopeStarts.back();
+    scopeStarts.pop_back();
+
+    // Unbind in reverse order so redeclarations in the same scope unwind correctly
+    while (declared.size() > start) {
+        NameEntry* entry = declared.back();
+        declared.pop_back();
+        entry->top = entry->top->shadowed;
+    }
+}
+
+const ResolvedSymbol& SymbolTable::declare(const ResolvedSymbol& sym) {
+    NameEntry* entry = intern(sym.name);
+
+    Binding* binding = arena.make<Binding>(sym, entry->top);
+    binding->sym.name = entry->name;
+
+    entry->top = binding;
+    declared.push_back(entry);
+    return binding->sym;
+}
+
+const ResolvedSymbol* SymbolTable::lookup(const char* name) const {
+    size_t length;
+    uint32_t hash = hashName(name, length);
+
+    NameEntry* entry = *findSlot(name, length, hash);
+    return (entry && entry->top) ? &entry->top->sym : nullptr;
+}
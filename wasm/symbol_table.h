@@ -0,0 +1,78 @@
+#pragma once
+
+#include "squirrel.h"
+#include "compiler/compiler.h"
+#include "compiler/ast.h"
+#include <stdint.h>
+#include <vector>
+#include "arena.h"
+
+
+// Declared name with the node it is bound to
+struct ResolvedSymbol {
+    const char* name;
+    SQCompilation::Node* node;
+    const char* kind;
+    bool isReadonly;
+    const char* module = nullptr;  // Bindings destructured from require("module")
+};
+
+
+// Lexically scoped symbol table shared by the AST visitors.
+//
+// Names are interned: every distinct spelling maps to one entry, so resolved
+// symbols compare by name pointer. Each entry keeps a stack of its visible
+// bindings, so lookup is a single hash probe regardless of scope depth or
+// scope size, and leaving a scope unbinds exactly the names it declared.
+//
+// Bindings, name entries and the hash slots all come from an arena that is
+// rewound when the table is destroyed, so a pass over thousands of small
+// scopes does not hit malloc once the arena is warm.
+class SymbolTable {
+    struct Binding {
+        ResolvedSymbol sym;
+        Binding* shadowed;  // Outer binding of the same name
+    };
+
+    struct NameEntry {
+        const char* name;  // Canonical spelling, views the AST string
+        size_t length;
+        uint32_t hash;
+        Binding* top;      // Innermost visible binding, nullptr if unbound
+    };
+
+    Arena& arena;
+    Arena::Mark arenaStart;
+
+    // Open addressing, linear probing; entries are stable, slots are not
+    NameEntry** slots;
+    size_t capacity;  // Power of two
+    size_t count;
+
+    std::vector<NameEntry*> declared;     // Names bound in open scopes, innermost last
+    std::vector<size_t> scopeStarts;      // Start of each open scope in `declared`
+
+    NameEntry* const* findSlot(const char* name, size_t length, uint32_t hash) const;
+    NameEntry* intern(const char* name);
+    void grow();
+
+public:
+    // The table must not outlive the AST, nor anything allocated from the
+    // arena before it
+    explicit SymbolTable(Arena& arena = scratchArena());
+    ~SymbolTable();
+
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    void pushScope();
+    // The root scope is never popped
+    void popScope();
+
+    // Bind sym.name in the innermost scope; returned symbol stays valid
+    // for the lifetime of the table, its name is the interned spelling
+    const ResolvedSymbol& declare(const ResolvedSymbol& sym);
+
+    // Innermost visible binding of name, nullptr if not declared
+    const ResolvedSymbol* lookup(const char* name) const;
+};
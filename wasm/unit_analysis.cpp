@@ -0,0 +1,370 @@
+#include "unit_analysis.h"
+#include "compiler/ast.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include "utils.h"
+#include "analyzer_config.h"
+#include "declaration_map.h"
+#include "profile.h"
+#include "cancel.h"
+
+
+using namespace SQCompilation;
+
+
+// Function body between its braces, [start, end)
+struct BodySpan {
+    size_t start, end;
+};
+
+struct AnalysisUnit {
+    size_t start, end;  // Root statement, end inclusive
+    int line;           // 1-based line of start
+    std::vector<BodySpan> bodies;
+    uint64_t key;
+    const DocumentSession::UnitAnalysis* cached;  // Results reused for this text
+    std::vector<const char*> outerNames;  // Declared outside the unit, used in its bodies
+};
+
+
+static size_t sourceOffset(const std::vector<size_t>& lines, size_t size, int line, int col) {
+    if (line < 1 || line > (int)lines.size() || col < 0) return SIZE_MAX;
+    return std::min(lines[line - 1] + (size_t)col, size);
+}
+
+// Only braced bodies can be blanked, `@(x) x + 1` has none
+static bool braceInterior(const std::string& src, const std::vector<size_t>& lines, Node* body, BodySpan& span) {
+    size_t open = sourceOffset(lines, src.size(), body->lineStart(), body->columnStart());
+    size_t close = sourceOffset(lines, src.size(), body->lineEnd(), body->columnEnd());
+    if (open >= src.size() || close == SIZE_MAX || src[open] != '{') return false;
+    // The end column may be at or right after the closing brace
+    if (close < src.size() && src[close] != '}' && close > 0 && src[close - 1] == '}') --close;
+    if (close >= src.size() || src[close] != '}' || close <= open) return false;
+    span = {open + 1, close};
+    return true;
+}
+
+static void collectBodies(const std::string& src, const std::vector<size_t>& lines, Node* node,
+                          std::vector<BodySpan>& bodies) {
+    if (!node) return;
+    switch (node->op()) {
+        case TO_FUNCTION: {
+            Block* body = static_cast<FunctionExpr*>(node)->body();
+            BodySpan span;
+            if (body && braceInterior(src, lines, body, span)) bodies.push_back(span);
+            break;
+        }
+        case TO_CLASS:
+            for (const auto& member : static_cast<ClassExpr*>(node)->members()) {
+                if (member.value && member.value->op() == TO_FUNCTION) {
+                    collectBodies(src, lines, member.value, bodies);
+                }
+            }
+            break;
+        case TO_VAR: {
+            Expr* init = static_cast<VarDecl*>(node)->initializer();
+            if (init && (init->op() == TO_FUNCTION || init->op() == TO_CLASS)) collectBodies(src, lines, init, bodies);
+            break;
+        }
+        case TO_CONST: {
+            Expr* value = static_cast<ConstDecl*>(node)->value();
+            if (value && (value->op() == TO_FUNCTION || value->op() == TO_CLASS)) collectBodies(src, lines, value, bodies);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static std::vector<AnalysisUnit> findUnits(const std::string& src, const std::vector<size_t>& lines, SqASTData* astData) {
+    std::vector<AnalysisUnit> units;
+    for (Statement* stmt : astData->root->statements()) {
+        std::vector<BodySpan> bodies;
+        collectBodies(src, lines, stmt, bodies);
+        if (bodies.empty()) continue;
+
+        size_t start = sourceOffset(lines, src.size(), stmt->lineStart(), stmt->columnStart());
+        size_t end = sourceOffset(lines, src.size(), stmt->lineEnd(), stmt->columnEnd());
+        if (start == SIZE_MAX || end == SIZE_MAX || start >= bodies.front().start) continue;
+        if (!units.empty() && start <= units.back().end) continue;
+        end = std::max(end, bodies.back().end);
+
+        AnalysisUnit unit = {};
+        unit.start = start;
+        unit.end = end;
+        unit.line = stmt->lineStart();
+        unit.bodies = std::move(bodies);
+        units.push_back(std::move(unit));
+    }
+    return units;
+}
+
+// Hash of the text outside all bodies. Not of positions, so that a line
+// added in one body does not invalidate the units after it.
+static uint64_t contextHash(const std::string& src, const std::vector<AnalysisUnit>& units) {
+    std::string outside;
+    outside.reserve(src.size());
+    size_t pos = 0;
+    for (const AnalysisUnit& unit : units) {
+        for (const BodySpan& body : unit.bodies) {
+            outside.append(src, pos, body.start - pos);
+            outside += '\0';
+            pos = body.end;
+        }
+    }
+    outside.append(src, pos, std::string::npos);
+    return hashBytes(outside.data(), outside.size());
+}
+
+static uint64_t unitKey(const std::string& src, const std::vector<size_t>& lines, const AnalysisUnit& unit,
+                        uint64_t context, uint64_t configKey) {
+    // Cached lines are relative, columns are not
+    uint64_t parts[5] = {
+        hashBytes(src.data() + unit.start, unit.end + 1 - unit.start),
+        unit.end + 1 - unit.start,
+        unit.start - lines[unit.line - 1],
+        context,
+        configKey,
+    };
+    return hashBytes(reinterpret_cast<const char*>(parts), sizeof(parts));
+}
+
+static const DocumentSession::UnitAnalysis* findUnitAnalysis(const DocumentSession& doc, uint64_t key) {
+    auto it = std::lower_bound(doc.unitAnalyses.begin(), doc.unitAnalyses.end(), key,
+        [](const DocumentSession::UnitAnalysis& u, uint64_t k) { return u.key < k; });
+    return it != doc.unitAnalyses.end() && it->key == key ? &*it : nullptr;
+}
+
+// Unit whose statement contains offset, nullptr for the module level
+static AnalysisUnit* unitAt(std::vector<AnalysisUnit>& units, size_t offset) {
+    auto it = std::upper_bound(units.begin(), units.end(), offset,
+        [](size_t off, const AnalysisUnit& u) { return off < u.start; });
+    if (it == units.begin()) return nullptr;
+    --it;
+    return offset <= it->end ? &*it : nullptr;
+}
+
+static bool inBodies(const AnalysisUnit& unit, size_t offset) {
+    for (const BodySpan& body : unit.bodies) {
+        if (offset >= body.start && offset < body.end) return true;
+    }
+    return false;
+}
+
+// Names each unit's bodies refer to that are declared outside the unit
+static void findOuterNames(const std::string& src, const std::vector<size_t>& lines,
+                           const DeclarationMap& index, std::vector<AnalysisUnit>& units) {
+    for (const DeclarationMap::Entry& e : index.entries()) {
+        if (!e.decl) continue;
+        size_t offset = sourceOffset(lines, src.size(), e.line, e.col);
+        AnalysisUnit* unit = unitAt(units, offset);
+        if (!unit || !unit->cached || !inBodies(*unit, offset)) continue;
+        size_t declared = sourceOffset(lines, src.size(), e.decl->lineStart(), e.decl->columnStart());
+        if (declared >= unit->start && declared <= unit->end) continue;
+        unit->outerNames.push_back(e.name);
+    }
+    for (AnalysisUnit& unit : units) {
+        // Names are interned, equal spellings share a pointer
+        std::sort(unit.outerNames.begin(), unit.outerNames.end(), std::less<const char*>());
+        unit.outerNames.erase(std::unique(unit.outerNames.begin(), unit.outerNames.end()), unit.outerNames.end());
+    }
+}
+
+// "//-file:" suppressions apply to the whole module wherever they are
+static bool hasFileDirective(const std::string& src, const AnalysisUnit& unit) {
+    static const char directive[] = "-file:";
+    for (const BodySpan& body : unit.bodies) {
+        if (std::search(src.begin() + body.start, src.begin() + body.end,
+                        directive, directive + sizeof(directive) - 1) != src.begin() + body.end) return true;
+    }
+    return false;
+}
+
+// Blank the unit's bodies in stub, line breaks kept, with `name;` for each
+// outer name. False if the names do not fit between the line breaks.
+static bool blankBodies(std::string& stub, const AnalysisUnit& unit) {
+    size_t next = 0;
+    for (const BodySpan& body : unit.bodies) {
+        size_t pos = body.start;
+        while (pos < body.end) {
+            if (stub[pos] == '\n' || stub[pos] == '\r') {
+                ++pos;
+                continue;
+            }
+            size_t lineEnd = pos;
+            while (lineEnd < body.end && stub[lineEnd] != '\n' && stub[lineEnd] != '\r') ++lineEnd;
+            for (; next < unit.outerNames.size(); ++next) {
+                size_t len = strlen(unit.outerNames[next]);
+                if (pos + len + 1 > lineEnd) break;
+                memcpy(&stub[pos], unit.outerNames[next], len);
+                stub[pos + len] = ';';
+                pos += len + 1;
+            }
+            std::fill(stub.begin() + pos, stub.begin() + lineEnd, ' ');
+            pos = lineEnd;
+        }
+    }
+    return next == unit.outerNames.size();
+}
+
+static std::string identifierAt(const std::string& src, size_t offset) {
+    size_t end = offset;
+    while (end < src.size() && (isalnum((unsigned char)src[end]) || src[end] == '_')) ++end;
+    return offset < end && !isdigit((unsigned char)src[offset]) ? src.substr(offset, end - offset) : std::string();
+}
+
+static size_t messageOffset(const DiagnosticBuffer& messages, size_t i, const std::vector<size_t>& lines, size_t size) {
+    return sourceOffset(lines, size, messages.line[i], messages.col[i]);
+}
+
+static void runAnalyzer(DocumentSession& doc, SqASTData* astData, const std::string& text,
+                        const std::string& configChain, DiagnosticBuffer& out) {
+    applyAnalyzerConfig(configChain);
+    doc.diagSink = &out;
+    {
+        ProfileScope profile(PROFILE_ANALYZE);
+        sq_analyzeast(doc.vm, astData, nullptr, text.c_str(), text.length());
+    }
+    doc.diagSink = nullptr;
+}
+
+// Parse and analyze the blanked text. False if it does not parse cleanly.
+static bool analyzeStub(DocumentSession& doc, const std::string& stub, const std::string& configChain,
+                        DiagnosticBuffer& out) {
+    // The session's parse results are of the real text
+    std::string parseError = doc.parseError;
+    DiagnosticBuffer parseMessages;
+    doc.diagSink = &parseMessages;
+    SqASTData* astData;
+    {
+        ProfileScope profile(PROFILE_PARSE);
+        astData = sq_parsetoast(doc.vm, stub.c_str(), stub.length(), "document", SQFalse, SQFalse);
+    }
+    doc.diagSink = nullptr;
+
+    bool parsed = astData && astData->root &&
+        std::find(parseMessages.isError.begin(), parseMessages.isError.end(), 1) == parseMessages.isError.end();
+    if (parsed && !callCancelled()) {
+        runAnalyzer(doc, astData, stub, configChain, out);
+    } else {
+        parsed = false;
+    }
+    if (astData) sq_releaseASTData(doc.vm, astData);
+    doc.parseError = parseError;
+    return parsed;
+}
+
+static bool anyOf(const std::vector<std::string>& names, const std::vector<std::string>& sorted) {
+    for (const std::string& name : names) {
+        if (std::binary_search(sorted.begin(), sorted.end(), name)) return true;
+    }
+    return false;
+}
+
+bool analyzeUnits(DocumentSession& doc, SqASTData* astData, const std::string& configChain,
+                  uint64_t configKey, DiagnosticBuffer& messages) {
+    const std::string& src = doc.source;
+    const std::vector<size_t>& lines = doc.lines();
+
+    std::vector<AnalysisUnit> units = findUnits(src, lines, astData);
+    uint64_t context = contextHash(src, units);
+    bool anyCached = false;
+    for (AnalysisUnit& unit : units) {
+        unit.key = unitKey(src, lines, unit, context, configKey);
+        unit.cached = findUnitAnalysis(doc, unit.key);
+        anyCached = anyCached || unit.cached;
+    }
+
+    // Blank the bodies of unchanged units
+    std::string stub;
+    std::vector<std::string> blankedNames;
+    bool partial = false;
+    if (anyCached) {
+        const DeclarationMap* index = doc.declarationIndex();
+        if (!index) return false;
+        findOuterNames(src, lines, *index, units);
+
+        stub = src;
+        for (AnalysisUnit& unit : units) {
+            if (!unit.cached) continue;
+            if (hasFileDirective(src, unit) || !blankBodies(stub, unit)) {
+                for (const BodySpan& body : unit.bodies) {
+                    stub.replace(body.start, body.end - body.start, src, body.start, body.end - body.start);
+                }
+                unit.cached = nullptr;
+                continue;
+            }
+            partial = true;
+            blankedNames.insert(blankedNames.end(), unit.outerNames.begin(), unit.outerNames.end());
+        }
+        std::sort(blankedNames.begin(), blankedNames.end());
+        blankedNames.erase(std::unique(blankedNames.begin(), blankedNames.end()), blankedNames.end());
+        if (partial && anyOf(doc.flaggedNames, blankedNames)) partial = false;
+    }
+
+    DiagnosticBuffer run;
+    if (partial) {
+        partial = analyzeStub(doc, stub, configChain, run);
+        for (size_t i = 0; partial && i < run.size(); ++i) {
+            size_t offset = messageOffset(run, i, lines, src.size());
+            AnalysisUnit* unit = offset == SIZE_MAX ? nullptr : unitAt(units, offset);
+            if (unit && unit->cached) continue;
+            if (offset != SIZE_MAX && std::binary_search(blankedNames.begin(), blankedNames.end(),
+                                                         identifierAt(src, offset))) partial = false;
+        }
+    }
+    if (!partial) {
+        for (AnalysisUnit& unit : units) unit.cached = nullptr;
+        run.clear();
+        if (callCancelled()) return false;
+        runAnalyzer(doc, astData, src, configChain, run);
+    }
+
+    // Messages of the run outside blanked units, by unit
+    std::vector<std::vector<uint32_t>> unitRun(units.size());
+    std::vector<std::string> flagged;
+    for (size_t i = 0; i < run.size(); ++i) {
+        size_t offset = messageOffset(run, i, lines, src.size());
+        AnalysisUnit* unit = offset == SIZE_MAX ? nullptr : unitAt(units, offset);
+        if (unit && unit->cached) continue;
+        messages.appendMessage(run, i);
+        if (unit) {
+            unitRun[unit - units.data()].push_back((uint32_t)i);
+        } else if (offset != SIZE_MAX) {
+            flagged.push_back(identifierAt(src, offset));
+        }
+    }
+
+    std::vector<DocumentSession::UnitAnalysis> unitAnalyses;
+    DiagnosticBuffer unitMessages;
+    for (size_t u = 0; u < units.size(); ++u) {
+        const AnalysisUnit& unit = units[u];
+        DocumentSession::UnitAnalysis entry = {unit.key, (uint32_t)unitMessages.size(), 0};
+        if (unit.cached) {
+            for (uint32_t i = unit.cached->first; i < unit.cached->first + unit.cached->count; ++i) {
+                messages.appendMessage(doc.unitMessages, i, unit.line);
+                unitMessages.appendMessage(doc.unitMessages, i);
+            }
+        } else {
+            for (uint32_t i : unitRun[u]) {
+                unitMessages.appendMessage(run, i, -unit.line);
+            }
+        }
+        entry.count = (uint32_t)unitMessages.size() - entry.first;
+        unitAnalyses.push_back(entry);
+    }
+    std::sort(unitAnalyses.begin(), unitAnalyses.end(),
+        [](const DocumentSession::UnitAnalysis& a, const DocumentSession::UnitAnalysis& b) { return a.key < b.key; });
+
+    std::sort(flagged.begin(), flagged.end());
+    flagged.erase(std::unique(flagged.begin(), flagged.end()), flagged.end());
+    if (!flagged.empty() && flagged.front().empty()) flagged.erase(flagged.begin());
+
+    doc.unitAnalyses = std::move(unitAnalyses);
+    doc.unitMessages = std::move(unitMessages);
+    doc.flaggedNames = std::move(flagged);
+    return true;
+}
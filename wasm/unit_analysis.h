@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include "document.h"
+#include "diagnostics.h"
+
+
+// Static analysis of a session's AST that only reanalyzes what changed.
+//
+// Root statements with function bodies (functions, classes with methods,
+// variables holding either) are units. Their messages are kept in the
+// session, keyed by the unit's text and by all text outside the bodies of
+// every unit, so that an edit inside one body leaves the results of the
+// other units valid while any change around them invalidates all of them.
+//
+// When some units are unchanged, the analyzer runs on a copy of the text
+// with their bodies blanked out, which leaves the module level and the
+// changed units to analyze. A blanked body keeps one use of each name
+// declared outside of it that it refers to, so that module-level usage
+// warnings stay the same. Messages inside blanked units are replaced by
+// their cached ones.
+//
+// Module-level warnings can still depend on what blanked bodies do with
+// such a name (assign it, for instance). Whenever a message of the run, or
+// a module-level message of the previous analysis, lands on a name that a
+// blanked body uses, the whole text is analyzed instead.
+
+// Appends the analyzer messages of astData, the session's current AST,
+// to messages and updates the session's unit results.
+// False if the call was cancelled; messages are then incomplete.
+bool analyzeUnits(DocumentSession& doc, SqASTData* astData, const std::string& configChain,
+                  uint64_t configKey, DiagnosticBuffer& messages);
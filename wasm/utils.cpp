@@ -1,27 +1,37 @@
 #include "utils.h"
+#include <string.h>
+#include "scan.h"
 
 std::string escapeJson(const char* s) {
     if (!s) return "";
 
-    // Count length and special chars to reserve exact size
-    size_t len = 0, extra = 0;
-    for (const char* p = s; *p; ++p, ++len) {
-        if (*p == '"' || *p == '\\' || *p == '\n' || *p == '\r' || *p == '\t')
-            ++extra;
-    }
-
+    // Copy runs between special chars as a whole
+    size_t len = strlen(s);
     std::string result;
-    result.reserve(len + extra);
+    result.reserve(len + 16);
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t special = findAnyOf(s, len, pos, "\"\\\n\r\t");
+        result.append(s + pos, special - pos);
+        if (special == len) break;
+        pos = special + 1;
 
-    for (const char* p = s; *p; ++p) {
-        switch (*p) {
+        switch (s[special]) {
             case '"':  result.append("\\\"", 2); break;
             case '\\': result.append("\\\\", 2); break;
             case '\n': result.append("\\n", 2); break;
             case '\r': result.append("\\r", 2); break;
             case '\t': result.append("\\t", 2); break;
-            default:   result.push_back(*p); break;
         }
     }
     return result;
 }
+
+uint64_t hashBytes(const char* data, size_t length) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    return h;
+}
@@ -1,5 +1,10 @@
 #pragma once
 
 #include <string>
+#include <stddef.h>
+#include <stdint.h>
 
 std::string escapeJson(const char* s);
+
+// 64-bit FNV-1a
+uint64_t hashBytes(const char* data, size_t length);